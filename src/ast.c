@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
@@ -13,6 +14,7 @@ const char* op_type_to_debug_string(OpType type) {
         case OP_SUB: return "Sub";
         case OP_MUL: return "Mul";
         case OP_DIV: return "Div";
+        case OP_MOD: return "Mod";
         case OP_POW: return "Pow";
         case OP_UADD: return "UAdd";
         case OP_USUB: return "USub";
@@ -29,6 +31,7 @@ const char* op_type_to_string(OpType type) {
         case OP_USUB: return "-";
         case OP_MUL: return "*";
         case OP_DIV: return "/";
+        case OP_MOD: return "%";
         case OP_POW: return "^";
         default: assert(false);
     }
@@ -40,6 +43,8 @@ const char* ast_type_to_debug_string(ASTType type) {
         case AST_PROGRAM: return "Program";
         case AST_ASSIGN: return "Assign";
         case AST_INTEGER: return "Integer";
+        case AST_BIGINT: return "BigInteger";
+        case AST_RATIONAL: return "Rational";
         case AST_REAL: return "Real";
         case AST_SYMBOL: return "Symbol";
         case AST_CONSTANT: return "Constant";
@@ -48,6 +53,7 @@ const char* ast_type_to_debug_string(ASTType type) {
         case AST_CALL: return "FuncCall";
         case AST_EMPTY: return "Empty";
         case AST_LIST: return "List";
+        case AST_FACTORED: return "Factored";
         case AST_TYPE_COUNT: assert(false);
     }
 }
@@ -61,6 +67,7 @@ u8 op_type_precedence(OpType type) {
             return 3;
         case OP_MUL:
         case OP_DIV:
+        case OP_MOD:
             return 2;
         case OP_ADD:
         case OP_SUB:
@@ -72,117 +79,389 @@ u8 op_type_precedence(OpType type) {
 
 ASTArray init_ast_array_with_capacity(Allocator *allocator, usize capacity) {
     ASTArray a = {0};
-    a.capacity = capacity;
-
-    // TODO: use capacity here
-    (void) allocator;
-
+    if (capacity > 0) {
+        a.data = alloc_array(allocator, AST*, capacity);
+        a.capacity = capacity;
+    }
     return a;
 }
 
 void ast_array_append(Allocator *allocator, ASTArray *array, AST *node) {
-    // TODO: we dont use the capacity field right now!
+    if (array->size == array->capacity) {
+        // grow geometrically, if the data is the last allocation of the arena
+        // this doesn't even copy
+        usize new_capacity = array->capacity*2;
+        if (new_capacity < MIN_AST_ARRAY_CAPACITY) {
+            new_capacity = MIN_AST_ARRAY_CAPACITY;
+        }
+        array->data = resize_array(allocator, AST*, array->data, array->capacity, new_capacity);
+        array->capacity = new_capacity;
+    }
 
-    AST **new_data = alloc(allocator, sizeof(AST)*(array->size+1));
+    array->data[array->size] = node;
+    array->size++;
+}
 
-    // currently we move old values to new_data because
-    // there is no real realloc for arena @cleanup
-    for (usize i = 0; i < array->size; i++) {
-        new_data[i] = array->data[i];
+AST *alloc_ast(Allocator *allocator, ASTType type) {
+    AST *node = alloc_type(allocator, AST);
+    node->type = type;
+    node->hash = 0;
+
+    if (allocator->stats != NULL) {
+        allocator->stats->nodes[type] += 1;
     }
-    new_data[array->size] = node;
 
-    array->data = new_data;
-    array->size++;
+    return node;
+}
+
+//
+// hash-consing
+//
+
+// macros, so the hashes of the static nodes below are constant expressions
+#define HASH_MIX(hash) ((hash) ^ ((hash) >> 32))
+#define HASH_COMBINE(hash, value) HASH_MIX(((u64)(hash) ^ (u64)(value)) * 0xff51afd7ed558ccdull)
+
+u64 hash_combine(u64 hash, u64 value) {
+    return HASH_COMBINE(hash, value);
+}
+
+u64 ast_hash(AST *node) {
+    // children already carry their hash, so this is O(1) per node (O(args) for calls)
+    u64 hash = hash_combine(1, node->type);
+    switch (node->type) {
+        case AST_INTEGER: return hash_combine(hash, (u64)node->integer.value);
+        case AST_BIGINT: return hash_combine(hash, bignum_hash(node->bigint.value));
+        case AST_RATIONAL: return hash_combine(hash_combine(hash, node->rational.numerator->hash), node->rational.denominator->hash);
+        case AST_FACTORED: return hash_combine(hash, node->factored.product->hash);
+        case AST_REAL: {
+            // 0.0 == -0.0, so both need the same hash
+            f64 value = node->real.value == 0 ? 0 : node->real.value;
+            u64 bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return hash_combine(hash, bits);
+        }
+        // names are interned, the pointer is unique
+        case AST_SYMBOL: return hash_combine(hash, (u64)(usize)node->symbol.name.str);
+        case AST_CONSTANT: return hash_combine(hash, node->constant.id);
+        case AST_BINOP: {
+            hash = hash_combine(hash, node->binop.op);
+            hash = hash_combine(hash, node->binop.left->hash);
+            return hash_combine(hash, node->binop.right->hash);
+        }
+        case AST_UNARYOP: return hash_combine(hash_combine(hash, node->unaryop.op), node->unaryop.operand->hash);
+        case AST_CALL: {
+            hash = hash_combine(hash, node->func_call.function);
+            for (usize i = 0; i < node->func_call.args.size; i++) {
+                hash = hash_combine(hash, node->func_call.args.data[i]->hash);
+            }
+            return hash;
+        }
+        // lists, programs, ... can be modified after creation, they are never consed
+        default: return 0;
+    }
+}
+
+bool ast_cons_eq(AST *a, AST *b) {
+    // Children are compared by pointer, they were consed before their parent. Equal
+    // children from different tables only cost us a duplicate, never a wrong match.
+    if (a->type != b->type || a->hash != b->hash) {
+        return false;
+    }
+
+    switch (a->type) {
+        case AST_INTEGER: return a->integer.value == b->integer.value;
+        case AST_BIGINT: return bignum_compare(a->bigint.value, b->bigint.value) == 0;
+        case AST_RATIONAL: return a->rational.numerator == b->rational.numerator && a->rational.denominator == b->rational.denominator;
+        case AST_FACTORED: return a->factored.product == b->factored.product;
+        // bitwise, so 0.0 and -0.0 stay separate nodes
+        case AST_REAL: return memcmp(&a->real.value, &b->real.value, sizeof(f64)) == 0;
+        case AST_SYMBOL: return a->symbol.name.str == b->symbol.name.str;
+        case AST_CONSTANT: return a->constant.id == b->constant.id;
+        case AST_BINOP: return a->binop.op == b->binop.op && a->binop.left == b->binop.left && a->binop.right == b->binop.right;
+        case AST_UNARYOP: return a->unaryop.op == b->unaryop.op && a->unaryop.operand == b->unaryop.operand;
+        case AST_CALL: {
+            if (a->func_call.function != b->func_call.function || a->func_call.args.size != b->func_call.args.size) {
+                return false;
+            }
+            for (usize i = 0; i < a->func_call.args.size; i++) {
+                if (a->func_call.args.data[i] != b->func_call.args.data[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default: panic("node type can't be consed");
+    }
+}
+
+usize cons_table_slot(ConsTable *table, AST *key) {
+    usize mask = table->capacity-1;
+    usize i = key->hash & mask;
+    while (table->nodes[i] != NULL && !ast_cons_eq(table->nodes[i], key)) {
+        i = (i+1) & mask;
+    }
+    return i;
+}
+
+AST *cons_table_find(ConsTable *table, AST *key) {
+    if (table->count == 0) {
+        return NULL;
+    }
+    return table->nodes[cons_table_slot(table, key)];
+}
+
+void cons_table_insert(ConsTable *table, AST *node) {
+    // keep the load factor below 1/2
+    if ((table->count+1)*2 > table->capacity) {
+        free(table->nodes);
+        table->capacity = table->capacity == 0 ? 256 : table->capacity*2;
+        table->nodes = calloc(table->capacity, sizeof(AST*));
+        assert(table->nodes != NULL);
+
+        // Reinserting in log order gives the same layout as inserting one by one,
+        // this is what makes removing the newest entry in cons_table_rewind correct.
+        for (usize i = 0; i < table->count; i++) {
+            table->nodes[cons_table_slot(table, table->log[i])] = table->log[i];
+        }
+    }
+
+    if (table->count == table->log_capacity) {
+        table->log_capacity = table->log_capacity == 0 ? 256 : table->log_capacity*2;
+        table->log = realloc(table->log, table->log_capacity*sizeof(AST*));
+        assert(table->log != NULL);
+    }
+
+    table->nodes[cons_table_slot(table, node)] = node;
+    table->log[table->count++] = node;
+}
+
+void cons_table_rewind(ConsTable *table, usize count) {
+    // Removes every node inserted after the first 'count' ones. With linear probing
+    // the newest entry can simply be cleared, no other entry ever probed past it.
+    assert(count <= table->count);
+    while (table->count > count) {
+        AST *node = table->log[--table->count];
+        table->nodes[cons_table_slot(table, node)] = NULL;
+    }
+}
+
+void free_cons_table(ConsTable *table) {
+    free(table->nodes);
+    free(table->log);
+    *table = (ConsTable){0};
+}
+
+AST *ast_cons(Allocator *allocator, AST key) {
+    key.hash = ast_hash(&key);
+
+    ConsTable *table = allocator->cons;
+    if (table != NULL) {
+        AST *node = cons_table_find(table, &key);
+        if (node != NULL) {
+            if (allocator->stats != NULL) {
+                allocator->stats->cons_hits += 1;
+            }
+            return node;
+        }
+    }
+
+    AST *node = alloc_ast(allocator, key.type);
+    *node = key;
+
+    if (table != NULL) {
+        cons_table_insert(table, node);
+    }
+
+    return node;
+}
+
+// same hashes as ast_hash computes
+#define STATIC_INTEGER(n) { .type = AST_INTEGER, .hash = HASH_COMBINE(HASH_COMBINE(1, AST_INTEGER), (i64)(n)), .integer.value = (n) }
+#define STATIC_CONSTANT(constant_id) { .type = AST_CONSTANT, .hash = HASH_COMBINE(HASH_COMBINE(1, AST_CONSTANT), (constant_id)), .constant.id = (constant_id) }
+
+#define STATIC_INTEGERS_4(n) STATIC_INTEGER(n), STATIC_INTEGER((n)+1), STATIC_INTEGER((n)+2), STATIC_INTEGER((n)+3)
+#define STATIC_INTEGERS_16(n) STATIC_INTEGERS_4(n), STATIC_INTEGERS_4((n)+4), STATIC_INTEGERS_4((n)+8), STATIC_INTEGERS_4((n)+12)
+#define STATIC_INTEGERS_64(n) STATIC_INTEGERS_16(n), STATIC_INTEGERS_16((n)+16), STATIC_INTEGERS_16((n)+32), STATIC_INTEGERS_16((n)+48)
+#define STATIC_INTEGERS_256(n) STATIC_INTEGERS_64(n), STATIC_INTEGERS_64((n)+64), STATIC_INTEGERS_64((n)+128), STATIC_INTEGERS_64((n)+192)
+
+// Small integers are preallocated, most numbers the simplifier creates are in this range.
+// The table is a constant initializer, so allocators on any thread can share it.
+static AST small_integers[] = {
+    STATIC_INTEGERS_256(SMALL_INTEGER_MIN),
+    STATIC_INTEGERS_256(SMALL_INTEGER_MIN+256),
+    STATIC_INTEGERS_256(SMALL_INTEGER_MIN+512),
+    STATIC_INTEGERS_256(SMALL_INTEGER_MIN+768),
+    STATIC_INTEGERS_256(SMALL_INTEGER_MIN+1024),
+    STATIC_INTEGER(SMALL_INTEGER_MAX),
 };
+_Static_assert(sizeof(small_integers) == (SMALL_INTEGER_MAX - SMALL_INTEGER_MIN + 1)*sizeof(AST), "small_integers has to cover SMALL_INTEGER_MIN to SMALL_INTEGER_MAX");
 
 AST* init_ast_integer(Allocator* allocator, i64 value) {
-    AST* node = alloc(allocator, sizeof(AST));
-    node->type = AST_INTEGER;
-    node->integer.value = value;
+    if (value >= SMALL_INTEGER_MIN && value <= SMALL_INTEGER_MAX) {
+        return &small_integers[value - SMALL_INTEGER_MIN];
+    }
+
+    return ast_cons(allocator, (AST){ .type = AST_INTEGER, .integer.value = value });
+}
+
+AST* init_ast_bigint(Allocator* allocator, Bignum value) {
+    // every integer has exactly one representation, so ast_match never has to compare
+    // an AST_INTEGER with an AST_BIGINT
+    i64 small;
+    if (bignum_to_i64(value, &small)) {
+        return init_ast_integer(allocator, small);
+    }
+
+    AST key = { .type = AST_BIGINT, .bigint.value = value };
+    key.hash = ast_hash(&key);
+    if (allocator->cons != NULL) {
+        AST *node = cons_table_find(allocator->cons, &key);
+        if (node != NULL) {
+            if (allocator->stats != NULL) {
+                allocator->stats->cons_hits += 1;
+            }
+            return node;
+        }
+    }
+
+    // the limbs may live in a temporary allocator, the node owns a copy
+    key.bigint.value = bignum_copy(allocator, value);
+    AST *node = alloc_ast(allocator, AST_BIGINT);
+    *node = key;
+    if (allocator->cons != NULL) {
+        cons_table_insert(allocator->cons, node);
+    }
     return node;
 }
 
+AST* init_ast_rational(Allocator* allocator, AST *numerator, AST *denominator) {
+    assert(ast_is_integer(numerator) && ast_is_integer(denominator));
+    return ast_cons(allocator, (AST){ .type = AST_RATIONAL, .rational = { numerator, denominator } });
+}
+
+AST* init_ast_factored(Allocator* allocator, AST *product) {
+    return ast_cons(allocator, (AST){ .type = AST_FACTORED, .factored.product = product });
+}
+
 AST* init_ast_real(Allocator* allocator, f64 value) {
-    AST* node = alloc(allocator, sizeof(AST));
-    node->type = AST_REAL;
-    node->real.value = value;
-    return node;
+    return ast_cons(allocator, (AST){ .type = AST_REAL, .real.value = value });
 }
 
 AST* init_ast_symbol(Allocator* allocator, String name) {
-    AST *node = alloc(allocator, sizeof(AST));
-    node->type = AST_SYMBOL;
-    node->symbol.name = name;
-    return node;
+    return ast_cons(allocator, (AST){ .type = AST_SYMBOL, .symbol.name = name });
 }
 
-AST* init_ast_constant(Allocator* allocator, String name) {
-    AST *node = alloc(allocator, sizeof(AST));
-    node->type = AST_CONSTANT;
-    node->constant.name = name;
-    return node;
+AST* init_ast_constant(Allocator* allocator, BuiltinConstant id) {
+    return ast_cons(allocator, (AST){ .type = AST_CONSTANT, .constant.id = id });
 }
 
 AST* init_ast_binop(Allocator* allocator, AST* left, AST* right, OpType op) {
-    AST *node = alloc(allocator, sizeof(AST));
-    node->type = AST_BINOP;
-    node->binop.left = left;
-    node->binop.right = right;
-    node->binop.op = op;
-    return node;
+    return ast_cons(allocator, (AST){ .type = AST_BINOP, .binop = { left, right, op } });
 }
 
 AST* init_ast_unaryop(Allocator* allocator, AST* operand, OpType op) {
-    AST *node = alloc(allocator, sizeof(AST));
-    node->type = AST_UNARYOP;
-    node->unaryop.operand = operand;
-    node->unaryop.op = op;
-    return node;
+    return ast_cons(allocator, (AST){ .type = AST_UNARYOP, .unaryop = { operand, op } });
 }
 
-AST* init_ast_call(Allocator* allocator, String name, ASTArray args) {
-    AST *node = alloc(allocator, sizeof(AST));
-    node->type = AST_CALL;
-    node->func_call.name = name;
-    node->func_call.args = args;
-    return node;
+AST* init_ast_call(Allocator* allocator, BuiltinFunction function, ASTArray args) {
+    return ast_cons(allocator, (AST){ .type = AST_CALL, .func_call = { function, args } });
 }
 
 AST* init_ast_program(Allocator* allocator) {
-    AST *node = alloc(allocator, sizeof(AST));
-    node->type = AST_PROGRAM;
-    node->program.statements.data = NULL;
-    node->program.statements.size = 0;
+    AST *node = alloc_ast(allocator, AST_PROGRAM);
+    node->program.statements = init_ast_array_with_capacity(allocator, 0);
     return node;
 }
 
 AST* init_ast_assign(Allocator* allocator, AST *target, AST *value) {
-    AST *node = alloc(allocator, sizeof(AST));
-    node->type = AST_ASSIGN;
+    AST *node = alloc_ast(allocator, AST_ASSIGN);
     node->assign.target = target;
     node->assign.value = value;
     return node;
 }
 
 AST* init_ast_empty(Allocator* allocator) {
-    AST* node = alloc(allocator, sizeof(AST));
-    node->type = AST_EMPTY;
+    AST *node = alloc_ast(allocator, AST_EMPTY);
     node->empty = true;
     return node;
 }
 
 AST *init_ast_list(Allocator *allocator, usize capacity) {
-    AST *node = alloc(allocator, sizeof(AST));
-    node->type = AST_LIST;
+    AST *node = alloc_ast(allocator, AST_LIST);
     node->list.nodes = init_ast_array_with_capacity(allocator, capacity);
     return node;
 }
 
+AST *ast_copy(Allocator *allocator, AST *node) {
+    switch (node->type) {
+        case AST_INTEGER: return init_ast_integer(allocator, node->integer.value);
+        case AST_BIGINT: return init_ast_bigint(allocator, node->bigint.value);
+        case AST_RATIONAL: return init_ast_rational(allocator, ast_copy(allocator, node->rational.numerator), ast_copy(allocator, node->rational.denominator));
+        case AST_FACTORED: return init_ast_factored(allocator, ast_copy(allocator, node->factored.product));
+        case AST_REAL: return init_ast_real(allocator, node->real.value);
+        // names are never allocated by the interpreter, so we can share them
+        case AST_SYMBOL: return init_ast_symbol(allocator, node->symbol.name);
+        case AST_CONSTANT: return init_ast_constant(allocator, node->constant.id);
+        case AST_BINOP: {
+            // copy the left spine without recursion, results like long sums are left-deep
+            usize count = 0;
+            for (AST *n = node; n->type == AST_BINOP; n = n->binop.left) {
+                count += 1;
+            }
+            AST **spine = malloc(count*sizeof(AST*));
+            assert(spine != NULL);
+            AST *n = node;
+            for (usize i = 0; i < count; i++) {
+                spine[i] = n;
+                n = n->binop.left;
+            }
+
+            AST *result = ast_copy(allocator, n);
+            for (usize i = count; i > 0; i--) {
+                AST *right = ast_copy(allocator, spine[i-1]->binop.right);
+                result = init_ast_binop(allocator, result, right, spine[i-1]->binop.op);
+            }
+            free(spine);
+            return result;
+        }
+        case AST_UNARYOP: return init_ast_unaryop(allocator, ast_copy(allocator, node->unaryop.operand), node->unaryop.op);
+        case AST_CALL: {
+            ASTArray args = init_ast_array_with_capacity(allocator, node->func_call.args.size);
+            for (usize i = 0; i < node->func_call.args.size; i++) {
+                ast_array_append(allocator, &args, ast_copy(allocator, node->func_call.args.data[i]));
+            }
+            return init_ast_call(allocator, node->func_call.function, args);
+        }
+        case AST_ASSIGN: return init_ast_assign(allocator, ast_copy(allocator, node->assign.target), ast_copy(allocator, node->assign.value));
+        case AST_PROGRAM: {
+            AST *program = init_ast_program(allocator);
+            for (usize i = 0; i < node->program.statements.size; i++) {
+                ast_array_append(allocator, &program->program.statements, ast_copy(allocator, node->program.statements.data[i]));
+            }
+            return program;
+        }
+        case AST_LIST: {
+            AST *list = init_ast_list(allocator, node->list.nodes.size);
+            for (usize i = 0; i < node->list.nodes.size; i++) {
+                list_append(allocator, list, ast_copy(allocator, node->list.nodes.data[i]));
+            }
+            return list;
+        }
+        case AST_EMPTY: return init_ast_empty(allocator);
+        case AST_TYPE_COUNT: break;
+    }
+
+    panic("unreachable");
+}
+
 void _ast_to_flat_array(Allocator* allocator, AST* ast, ASTArray* array) {
 
     switch (ast->type) {
         case AST_INTEGER:
+        case AST_BIGINT:
+        case AST_RATIONAL:
+        case AST_FACTORED:
         case AST_SYMBOL:
             ast_array_append(allocator, array, ast);
             break;
@@ -217,6 +496,9 @@ bool ast_contains(AST *node, AST *target) {
     } else {
         switch (node->type) {
             case AST_INTEGER:
+            case AST_BIGINT:
+            case AST_RATIONAL:
+            case AST_FACTORED:
                 return false;
             case AST_BINOP:
                 return ast_contains(node->binop.left, target) || ast_contains(node->binop.right, target);
@@ -232,24 +514,27 @@ f64 ast_to_f64(AST *node) {
         
         case AST_INTEGER:
             return (f64) node->integer.value;
+
+        case AST_BIGINT:
+            return bignum_to_f64(node->bigint.value);
+
+        case AST_RATIONAL:
+            return ast_to_f64(node->rational.numerator) / ast_to_f64(node->rational.denominator);
         
         case AST_REAL:
             return node->real.value;
         
         case AST_BINOP: {
+            // a quotient of numbers which aren't rationals, like pi/2
             assert(ast_is_numeric(node));
-            assert(node->binop.left->type == AST_INTEGER);
-            assert(node->binop.right->type == AST_INTEGER);
-            return (f64) node->binop.left->integer.value / (f64) node->binop.right->integer.value;
+            return ast_to_f64(node->binop.left) / ast_to_f64(node->binop.right);
         }
 
         case AST_CONSTANT: {
-            if (string_eq(node->constant.name, init_string("e"))) {
-                return M_E;
-            } else if (string_eq(node->constant.name, init_string("pi"))) {
-                return M_PI;
-            } else {
-                todo()
+            switch (node->constant.id) {
+                case CONSTANT_E: return M_E;
+                case CONSTANT_PI: return M_PI;
+                default: todo()
             }
         }
 
@@ -258,18 +543,37 @@ f64 ast_to_f64(AST *node) {
     }
 }
 
-inline bool ast_is_fraction(AST* node) {
-    if (node->type == AST_BINOP) {
-        if (node->binop.left->type == AST_INTEGER && node->binop.right->type == AST_INTEGER) {
-            return true;
-        }
+bool ast_is_integer(AST *node) {
+    return node->type == AST_INTEGER || node->type == AST_BIGINT;
+}
+
+bool ast_is_rational(AST *node) {
+    return ast_is_integer(node) || node->type == AST_RATIONAL;
+}
+
+Bignum ast_to_bignum(Allocator *allocator, AST *node) {
+    if (node->type == AST_BIGINT) {
+        return node->bigint.value;
     }
+    assert(node->type == AST_INTEGER);
+    return bignum_from_i64(allocator, node->integer.value);
+}
 
+bool ast_to_u64(AST *node, u64 *value) {
+    if (node->type == AST_INTEGER) {
+        *value = (u64)node->integer.value;
+        return node->integer.value >= 0;
+    }
+    if (node->type == AST_BIGINT && !node->bigint.value.negative && node->bigint.value.size == 2) {
+        Bignum a = node->bigint.value;
+        *value = ((u64)a.limbs[1] << 32) | a.limbs[0];
+        return true;
+    }
     return false;
 }
 
 bool ast_is_numeric(AST* node) {
-    if (node->type == AST_INTEGER || node->type == AST_REAL) {
+    if (ast_is_rational(node) || node->type == AST_REAL) {
         return true;
     }
 
@@ -291,3 +595,89 @@ bool ast_is_numeric(AST* node) {
 void list_append(Allocator *allocator, AST *list, AST *node) {
     ast_array_append(allocator, &list->list.nodes, node);
 }
+
+AST ast_zero = STATIC_INTEGER(0);
+AST ast_one = STATIC_INTEGER(1);
+AST ast_minus_one = STATIC_INTEGER(-1);
+AST ast_two = STATIC_INTEGER(2);
+AST ast_pi = STATIC_CONSTANT(CONSTANT_PI);
+AST ast_e = STATIC_CONSTANT(CONSTANT_E);
+
+bool pattern_match(Pattern *pattern, AST *node, AST **bindings) {
+    bool matched = false;
+    switch (pattern->type) {
+        case PATTERN_ANY: matched = true; break;
+        case PATTERN_ANY_INTEGER: matched = ast_is_integer(node); break;
+        case PATTERN_INTEGER: matched = node->type == AST_INTEGER && node->integer.value == pattern->value; break;
+        case PATTERN_CONSTANT: matched = node->type == AST_CONSTANT && node->constant.id == pattern->constant; break;
+        case PATTERN_BINOP: {
+            matched = (
+                node->type == AST_BINOP &&
+                node->binop.op == pattern->binop.op &&
+                pattern_match(pattern->binop.left, node->binop.left, bindings) &&
+                pattern_match(pattern->binop.right, node->binop.right, bindings)
+            );
+            break;
+        }
+        case PATTERN_UNARYOP: {
+            matched = (
+                node->type == AST_UNARYOP &&
+                node->unaryop.op == pattern->unaryop.op &&
+                pattern_match(pattern->unaryop.operand, node->unaryop.operand, bindings)
+            );
+            break;
+        }
+        case PATTERN_CALL: {
+            if (node->type != AST_CALL || node->func_call.function != pattern->call.function) {
+                break;
+            }
+            usize i = 0;
+            for (; i < PATTERN_MAX_ARGS && pattern->call.args[i] != NULL; i++) {
+                if (i >= node->func_call.args.size || !pattern_match(pattern->call.args[i], node->func_call.args.data[i], bindings)) {
+                    break;
+                }
+            }
+            matched = (i == PATTERN_MAX_ARGS || pattern->call.args[i] == NULL) && i == node->func_call.args.size;
+            break;
+        }
+    }
+
+    if (matched && pattern->slot != 0) {
+        assert(bindings != NULL && pattern->slot < PATTERN_MAX_SLOTS);
+        if (bindings[pattern->slot] != NULL) {
+            return ast_match(bindings[pattern->slot], node);
+        }
+        bindings[pattern->slot] = node;
+    }
+
+    return matched;
+}
+
+AST *pattern_build(Allocator *allocator, Pattern *pattern, AST **bindings) {
+    if (pattern->slot != 0) {
+        assert(bindings != NULL && bindings[pattern->slot] != NULL);
+        return bindings[pattern->slot];
+    }
+
+    switch (pattern->type) {
+        case PATTERN_INTEGER: return init_ast_integer(allocator, pattern->value);
+        case PATTERN_CONSTANT: return init_ast_constant(allocator, pattern->constant);
+        case PATTERN_BINOP: {
+            AST *left = pattern_build(allocator, pattern->binop.left, bindings);
+            AST *right = pattern_build(allocator, pattern->binop.right, bindings);
+            return init_ast_binop(allocator, left, right, pattern->binop.op);
+        }
+        case PATTERN_UNARYOP: return init_ast_unaryop(allocator, pattern_build(allocator, pattern->unaryop.operand, bindings), pattern->unaryop.op);
+        case PATTERN_CALL: {
+            ASTArray args = init_ast_array_with_capacity(allocator, PATTERN_MAX_ARGS);
+            for (usize i = 0; i < PATTERN_MAX_ARGS && pattern->call.args[i] != NULL; i++) {
+                ast_array_append(allocator, &args, pattern_build(allocator, pattern->call.args[i], bindings));
+            }
+            return init_ast_call(allocator, pattern->call.function, args);
+        }
+        case PATTERN_ANY:
+        case PATTERN_ANY_INTEGER: break;
+    }
+
+    panic("unbound slot in pattern");
+}
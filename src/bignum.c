@@ -0,0 +1,1051 @@
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "casc.h"
+
+// The limbs_* functions work on plain magnitudes: arrays of base 2^32 digits, least
+// significant first. The bignum_* functions on top of them handle signs, normalization
+// and memory.
+
+//
+// magnitudes
+//
+
+usize limbs_normalize(const u32 *a, usize size) {
+    while (size > 0 && a[size-1] == 0) {
+        size -= 1;
+    }
+    return size;
+}
+
+i32 limbs_compare(const u32 *a, usize a_size, const u32 *b, usize b_size) {
+    a_size = limbs_normalize(a, a_size);
+    b_size = limbs_normalize(b, b_size);
+    if (a_size != b_size) {
+        return a_size < b_size ? -1 : 1;
+    }
+    for (usize i = a_size; i > 0; i--) {
+        if (a[i-1] != b[i-1]) {
+            return a[i-1] < b[i-1] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// r = a + b with a_size >= b_size, r has a_size limbs (and may be a), returns the carry
+u32 limbs_add(u32 *r, const u32 *a, usize a_size, const u32 *b, usize b_size) {
+    assert(a_size >= b_size);
+    u64 carry = 0;
+    for (usize i = 0; i < b_size; i++) {
+        carry += (u64)a[i] + b[i];
+        r[i] = (u32)carry;
+        carry >>= 32;
+    }
+    for (usize i = b_size; i < a_size; i++) {
+        carry += a[i];
+        r[i] = (u32)carry;
+        carry >>= 32;
+    }
+    return (u32)carry;
+}
+
+// r = a - b with a >= b and a_size >= b_size, r has a_size limbs (and may be a)
+void limbs_sub(u32 *r, const u32 *a, usize a_size, const u32 *b, usize b_size) {
+    assert(a_size >= b_size);
+    i64 borrow = 0;
+    for (usize i = 0; i < b_size; i++) {
+        i64 t = (i64)a[i] - b[i] - borrow;
+        borrow = t < 0;
+        r[i] = (u32)t;
+    }
+    for (usize i = b_size; i < a_size; i++) {
+        i64 t = (i64)a[i] - borrow;
+        borrow = t < 0;
+        r[i] = (u32)t;
+    }
+    assert(borrow == 0);
+}
+
+// r = a * b, r has a_size + b_size limbs and must not overlap a or b
+void limbs_mul_basecase(u32 *r, const u32 *a, usize a_size, const u32 *b, usize b_size) {
+    memset(r, 0, (a_size+b_size)*sizeof(u32));
+    for (usize j = 0; j < b_size; j++) {
+        u64 carry = 0;
+        for (usize i = 0; i < a_size; i++) {
+            carry += (u64)a[i]*b[j] + r[i+j];
+            r[i+j] = (u32)carry;
+            carry >>= 32;
+        }
+        r[a_size+j] = (u32)carry;
+    }
+}
+
+// a = a * m + add in place, returns the limb that didn't fit
+u32 limbs_mul_small(u32 *a, usize size, u32 m, u32 add) {
+    u64 carry = add;
+    for (usize i = 0; i < size; i++) {
+        carry += (u64)a[i]*m;
+        a[i] = (u32)carry;
+        carry >>= 32;
+    }
+    return (u32)carry;
+}
+
+// q = a / d, q may be a, returns the remainder
+u32 limbs_divmod_small(u32 *q, const u32 *a, usize size, u32 d) {
+    assert(d != 0);
+    u64 remainder = 0;
+    for (usize i = size; i > 0; i--) {
+        u64 n = (remainder << 32) | a[i-1];
+        q[i-1] = (u32)(n / d);
+        remainder = n % d;
+    }
+    return (u32)remainder;
+}
+
+//
+// multiplication
+//
+
+void limbs_mul(Allocator *tmp, u32 *r, const u32 *a, usize a_size, const u32 *b, usize b_size);
+
+// adds a (of size) into r at offset, the carry runs up to the end of r
+void limbs_add_at(u32 *r, usize r_size, usize offset, const u32 *a, usize size) {
+    size = limbs_normalize(a, size);
+    if (size == 0) {
+        return;
+    }
+    assert(offset + size <= r_size);
+    u32 carry = limbs_add(&r[offset], &r[offset], size, a, size);
+    for (usize i = offset+size; carry != 0; i++) {
+        assert(i < r_size);
+        r[i] += 1;
+        carry = r[i] == 0;
+    }
+}
+
+// b is much smaller than a: multiply a in pieces of b's size
+void limbs_mul_unbalanced(Allocator *tmp, u32 *r, const u32 *a, usize a_size, const u32 *b, usize b_size) {
+    memset(r, 0, (a_size+b_size)*sizeof(u32));
+    u32 *piece = alloc_array(tmp, u32, 2*b_size);
+    for (usize offset = 0; offset < a_size; offset += b_size) {
+        usize size = a_size - offset < b_size ? a_size - offset : b_size;
+        limbs_mul(tmp, piece, b, b_size, &a[offset], size);
+        limbs_add_at(r, a_size+b_size, offset, piece, b_size+size);
+    }
+}
+
+// a = a1*B^m + a0, b = b1*B^m + b0
+// a*b = a1*b1*B^2m + ((a0+a1)(b0+b1) - a0*b0 - a1*b1)*B^m + a0*b0
+void limbs_mul_karatsuba(Allocator *tmp, u32 *r, const u32 *a, usize a_size, const u32 *b, usize b_size) {
+    usize m = (a_size+1)/2;
+    assert(b_size > m);
+
+    const u32 *a0 = a, *a1 = &a[m];
+    const u32 *b0 = b, *b1 = &b[m];
+    usize a1_size = a_size - m, b1_size = b_size - m;
+
+    // a0*b0 goes to the low half of r, a1*b1 to the high half
+    memset(r, 0, (a_size+b_size)*sizeof(u32));
+    limbs_mul(tmp, r, a0, m, b0, m);
+    limbs_mul(tmp, &r[2*m], a1, a1_size, b1, b1_size);
+
+    u32 *sa = alloc_array(tmp, u32, m+1);
+    u32 *sb = alloc_array(tmp, u32, m+1);
+    sa[m] = limbs_add(sa, a0, m, a1, a1_size);
+    sb[m] = limbs_add(sb, b0, m, b1, b1_size);
+
+    u32 *middle = alloc_array(tmp, u32, 2*m+2);
+    limbs_mul(tmp, middle, sa, m+1, sb, m+1);
+    limbs_sub(middle, middle, 2*m+2, r, 2*m);
+    limbs_sub(middle, middle, 2*m+2, &r[2*m], a1_size+b1_size);
+
+    limbs_add_at(r, a_size+b_size, m, middle, 2*m+2);
+}
+
+// Signed values for the Toom-3 evaluation and interpolation, the magnitudes live in
+// the temporary allocator.
+Bignum bignum_view(const u32 *limbs, usize size) {
+    return (Bignum){ (u32*)limbs, limbs_normalize(limbs, size), false };
+}
+
+Bignum bignum_shift_limbs(Allocator *allocator, Bignum a, usize count) {
+    if (a.size == 0) {
+        return a;
+    }
+    u32 *limbs = alloc_array(allocator, u32, a.size+count);
+    memset(limbs, 0, count*sizeof(u32));
+    memcpy(&limbs[count], a.limbs, a.size*sizeof(u32));
+    return (Bignum){ limbs, a.size+count, a.negative };
+}
+
+Bignum bignum_mul_small(Allocator *allocator, Bignum a, u32 m) {
+    u32 *limbs = alloc_array(allocator, u32, a.size+1);
+    memcpy(limbs, a.limbs, a.size*sizeof(u32));
+    limbs[a.size] = limbs_mul_small(limbs, a.size, m, 0);
+    Bignum result = bignum_view(limbs, a.size+1);
+    result.negative = result.size > 0 && a.negative;
+    return result;
+}
+
+// a / d, the division has to be exact
+Bignum bignum_divexact_small(Allocator *allocator, Bignum a, u32 d) {
+    if (a.size == 0) {
+        return a;
+    }
+    u32 *limbs = alloc_array(allocator, u32, a.size);
+    u32 remainder = limbs_divmod_small(limbs, a.limbs, a.size, d);
+    assert(remainder == 0);
+    Bignum result = bignum_view(limbs, a.size);
+    result.negative = result.size > 0 && a.negative;
+    return result;
+}
+
+Bignum bignum_mul_signed(Allocator *tmp, Bignum a, Bignum b) {
+    if (a.size == 0 || b.size == 0) {
+        return (Bignum){0};
+    }
+    u32 *limbs = alloc_array(tmp, u32, a.size+b.size);
+    if (a.size >= b.size) {
+        limbs_mul(tmp, limbs, a.limbs, a.size, b.limbs, b.size);
+    } else {
+        limbs_mul(tmp, limbs, b.limbs, b.size, a.limbs, a.size);
+    }
+    Bignum result = bignum_view(limbs, a.size+b.size);
+    result.negative = a.negative != b.negative;
+    return result;
+}
+
+// Splits both numbers in three parts of k limbs and evaluates them as polynomials in
+// B^k at 0, 1, -1, -2 and infinity. That's five products of a third of the size
+// instead of nine, the interpolation is Bodrato's sequence.
+void limbs_mul_toom3(Allocator *tmp, u32 *r, const u32 *a, usize a_size, const u32 *b, usize b_size) {
+    usize k = (a_size+2)/3;
+    assert(b_size > 2*k);
+
+    Bignum a0 = bignum_view(a, k), a1 = bignum_view(&a[k], k), a2 = bignum_view(&a[2*k], a_size-2*k);
+    Bignum b0 = bignum_view(b, k), b1 = bignum_view(&b[k], k), b2 = bignum_view(&b[2*k], b_size-2*k);
+
+    // p(1) = a0+a1+a2, p(-1) = a0-a1+a2, p(-2) = 2*(p(-1)+a2) - a0
+    Bignum pa = bignum_add(tmp, a0, a2);
+    Bignum pa1 = bignum_add(tmp, pa, a1);
+    Bignum pam1 = bignum_sub(tmp, pa, a1);
+    Bignum pam2 = bignum_sub(tmp, bignum_mul_small(tmp, bignum_add(tmp, pam1, a2), 2), a0);
+
+    Bignum pb = bignum_add(tmp, b0, b2);
+    Bignum pb1 = bignum_add(tmp, pb, b1);
+    Bignum pbm1 = bignum_sub(tmp, pb, b1);
+    Bignum pbm2 = bignum_sub(tmp, bignum_mul_small(tmp, bignum_add(tmp, pbm1, b2), 2), b0);
+
+    Bignum r0 = bignum_mul_signed(tmp, a0, b0);
+    Bignum r1 = bignum_mul_signed(tmp, pa1, pb1);
+    Bignum rm1 = bignum_mul_signed(tmp, pam1, pbm1);
+    Bignum rm2 = bignum_mul_signed(tmp, pam2, pbm2);
+    Bignum rinf = bignum_mul_signed(tmp, a2, b2);
+
+    Bignum c3 = bignum_divexact_small(tmp, bignum_sub(tmp, rm2, r1), 3);
+    Bignum c1 = bignum_divexact_small(tmp, bignum_sub(tmp, r1, rm1), 2);
+    Bignum c2 = bignum_sub(tmp, rm1, r0);
+    c3 = bignum_add(tmp, bignum_divexact_small(tmp, bignum_sub(tmp, c2, c3), 2), bignum_mul_small(tmp, rinf, 2));
+    c2 = bignum_sub(tmp, bignum_add(tmp, c2, c1), rinf);
+    c1 = bignum_sub(tmp, c1, c3);
+
+    Bignum result = r0;
+    result = bignum_add(tmp, result, bignum_shift_limbs(tmp, c1, k));
+    result = bignum_add(tmp, result, bignum_shift_limbs(tmp, c2, 2*k));
+    result = bignum_add(tmp, result, bignum_shift_limbs(tmp, c3, 3*k));
+    result = bignum_add(tmp, result, bignum_shift_limbs(tmp, rinf, 4*k));
+
+    assert(!result.negative && result.size <= a_size+b_size);
+    memset(r, 0, (a_size+b_size)*sizeof(u32));
+    memcpy(r, result.limbs, result.size*sizeof(u32));
+}
+
+// r = a * b with a_size >= b_size > 0, r has a_size + b_size limbs and must not
+// overlap a or b, tmp holds the intermediate results
+void limbs_mul(Allocator *tmp, u32 *r, const u32 *a, usize a_size, const u32 *b, usize b_size) {
+    assert(a_size >= b_size && b_size > 0);
+
+    if (b_size < BIGNUM_KARATSUBA_THRESHOLD) {
+        limbs_mul_basecase(r, a, a_size, b, b_size);
+    } else if (2*b_size <= a_size + 1) {
+        limbs_mul_unbalanced(tmp, r, a, a_size, b, b_size);
+    } else if (b_size < BIGNUM_TOOM3_THRESHOLD || 3*b_size <= 2*(a_size+2)) {
+        limbs_mul_karatsuba(tmp, r, a, a_size, b, b_size);
+    } else {
+        limbs_mul_toom3(tmp, r, a, a_size, b, b_size);
+    }
+}
+
+//
+// division
+//
+
+u32 count_leading_zeros(u32 x) {
+    assert(x != 0);
+    u32 n = 0;
+    while ((x & 0x80000000u) == 0) {
+        x <<= 1;
+        n += 1;
+    }
+    return n;
+}
+
+// Knuth's algorithm D: q = a / b and r = a % b with a_size >= b_size >= 2 and a
+// normalized b. q has a_size - b_size + 1 limbs, r has b_size limbs.
+void limbs_divmod(u32 *q, u32 *r, const u32 *a, usize a_size, const u32 *b, usize b_size) {
+    assert(a_size >= b_size && b_size >= 2 && b[b_size-1] != 0);
+    const u64 base = 1ull << 32;
+
+    // shift both so the top limb of the divisor has its highest bit set, this keeps
+    // the estimate of every quotient limb at most 2 too big
+    u32 s = count_leading_zeros(b[b_size-1]);
+    u32 *bn = malloc(b_size*sizeof(u32));
+    u32 *an = malloc((a_size+1)*sizeof(u32));
+    assert(bn != NULL && an != NULL);
+    for (usize i = b_size-1; i > 0; i--) {
+        bn[i] = (b[i] << s) | (u32)((u64)b[i-1] >> (32-s));
+    }
+    bn[0] = b[0] << s;
+    an[a_size] = (u32)((u64)a[a_size-1] >> (32-s));
+    for (usize i = a_size-1; i > 0; i--) {
+        an[i] = (a[i] << s) | (u32)((u64)a[i-1] >> (32-s));
+    }
+    an[0] = a[0] << s;
+
+    for (usize j = a_size - b_size + 1; j > 0; j--) {
+        usize k = j-1;
+        u64 numerator = ((u64)an[k+b_size] << 32) | an[k+b_size-1];
+        u64 qhat = numerator / bn[b_size-1];
+        u64 rhat = numerator % bn[b_size-1];
+        while (qhat >= base || qhat*bn[b_size-2] > ((rhat << 32) | an[k+b_size-2])) {
+            qhat -= 1;
+            rhat += bn[b_size-1];
+            if (rhat >= base) {
+                break;
+            }
+        }
+
+        // an[k..k+b_size] -= qhat * bn
+        i64 borrow = 0;
+        u64 carry = 0;
+        for (usize i = 0; i < b_size; i++) {
+            u64 p = qhat*bn[i] + carry;
+            carry = p >> 32;
+            i64 t = (i64)an[i+k] - (i64)(u32)p - borrow;
+            an[i+k] = (u32)t;
+            borrow = t < 0;
+        }
+        i64 t = (i64)an[k+b_size] - (i64)carry - borrow;
+        an[k+b_size] = (u32)t;
+
+        // the estimate was one too big, add bn back
+        if (t < 0) {
+            qhat -= 1;
+            u64 c = 0;
+            for (usize i = 0; i < b_size; i++) {
+                c += (u64)an[i+k] + bn[i];
+                an[i+k] = (u32)c;
+                c >>= 32;
+            }
+            an[k+b_size] += (u32)c;
+        }
+        q[k] = (u32)qhat;
+    }
+
+    if (r != NULL) {
+        for (usize i = 0; i < b_size-1; i++) {
+            r[i] = (an[i] >> s) | (u32)((u64)an[i+1] << (32-s));
+        }
+        r[b_size-1] = an[b_size-1] >> s;
+    }
+
+    free(an);
+    free(bn);
+}
+
+//
+// bignum
+//
+
+Bignum bignum_from_u64(Allocator *allocator, u64 value) {
+    u32 *limbs = alloc_array(allocator, u32, 2);
+    limbs[0] = (u32)value;
+    limbs[1] = (u32)(value >> 32);
+    return bignum_view(limbs, 2);
+}
+
+Bignum bignum_from_i64(Allocator *allocator, i64 value) {
+    // the magnitude of INT64_MIN only fits into an u64
+    u64 magnitude = value < 0 ? -(u64)value : (u64)value;
+    Bignum result = bignum_from_u64(allocator, magnitude);
+    result.negative = value < 0;
+    return result;
+}
+
+Bignum bignum_from_f64(Allocator *allocator, f64 value) {
+    assert(isfinite(value) && value == floor(value));
+
+    // value = mantissa * 2^exponent with an integer mantissa of 53 bits
+    i32 exponent;
+    f64 fraction = frexp(fabs(value), &exponent);
+    u64 mantissa = (u64)ldexp(fraction, 53);
+    exponent -= 53;
+    if (exponent <= 0) {
+        Bignum result = bignum_from_u64(allocator, mantissa >> -exponent);
+        result.negative = result.size > 0 && value < 0;
+        return result;
+    }
+
+    usize shift = exponent/32;
+    u32 *limbs = alloc_array(allocator, u32, shift+3);
+    memset(limbs, 0, (shift+3)*sizeof(u32));
+    limbs[shift] = (u32)mantissa;
+    limbs[shift+1] = (u32)(mantissa >> 32);
+    limbs[shift+2] = limbs_mul_small(&limbs[shift], 2, 1u << (exponent%32), 0);
+
+    Bignum result = bignum_view(limbs, shift+3);
+    result.negative = value < 0;
+    return result;
+}
+
+Bignum bignum_copy(Allocator *allocator, Bignum a) {
+    if (a.size == 0) {
+        return (Bignum){0};
+    }
+    u32 *limbs = alloc_array(allocator, u32, a.size);
+    memcpy(limbs, a.limbs, a.size*sizeof(u32));
+    return (Bignum){ limbs, a.size, a.negative };
+}
+
+bool bignum_to_i64(Bignum a, i64 *value) {
+    if (a.size > 2) {
+        return false;
+    }
+    u64 magnitude = 0;
+    for (usize i = a.size; i > 0; i--) {
+        magnitude = (magnitude << 32) | a.limbs[i-1];
+    }
+
+    if (a.negative) {
+        if (magnitude > (u64)INT64_MAX + 1) {
+            return false;
+        }
+        *value = magnitude == (u64)INT64_MAX + 1 ? INT64_MIN : -(i64)magnitude;
+    } else {
+        if (magnitude > (u64)INT64_MAX) {
+            return false;
+        }
+        *value = (i64)magnitude;
+    }
+    return true;
+}
+
+f64 bignum_to_f64(Bignum a) {
+    // the top three limbs hold more bits than a double
+    f64 result = 0.0;
+    usize low = a.size > 3 ? a.size-3 : 0;
+    for (usize i = a.size; i > low; i--) {
+        result = result*4294967296.0 + a.limbs[i-1];
+    }
+    result = ldexp(result, 32*low);
+    return a.negative ? -result : result;
+}
+
+u64 bignum_hash(Bignum a) {
+    u64 hash = hash_combine(a.negative, a.size);
+    for (usize i = 0; i < a.size; i++) {
+        hash = hash_combine(hash, a.limbs[i]);
+    }
+    return hash;
+}
+
+i32 bignum_compare(Bignum a, Bignum b) {
+    if (a.negative != b.negative) {
+        return a.negative ? -1 : 1;
+    }
+    i32 result = limbs_compare(a.limbs, a.size, b.limbs, b.size);
+    return a.negative ? -result : result;
+}
+
+Bignum bignum_negate(Bignum a) {
+    a.negative = a.size > 0 && !a.negative;
+    return a;
+}
+
+// |a| + |b| or |a| - |b|, with the given sign
+Bignum bignum_add_magnitudes(Allocator *allocator, Bignum a, Bignum b, bool subtract, bool negative) {
+    if (a.size < b.size || (subtract && limbs_compare(a.limbs, a.size, b.limbs, b.size) < 0)) {
+        Bignum t = a; a = b; b = t;
+        negative = subtract ? !negative : negative;
+    }
+
+    u32 *limbs = alloc_array(allocator, u32, a.size+1);
+    if (subtract) {
+        limbs_sub(limbs, a.limbs, a.size, b.limbs, b.size);
+        limbs[a.size] = 0;
+    } else {
+        limbs[a.size] = limbs_add(limbs, a.limbs, a.size, b.limbs, b.size);
+    }
+
+    Bignum result = bignum_view(limbs, a.size+1);
+    result.negative = result.size > 0 && negative;
+    return result;
+}
+
+Bignum bignum_add(Allocator *allocator, Bignum a, Bignum b) {
+    return bignum_add_magnitudes(allocator, a, b, a.negative != b.negative, a.negative);
+}
+
+Bignum bignum_sub(Allocator *allocator, Bignum a, Bignum b) {
+    return bignum_add(allocator, a, bignum_negate(b));
+}
+
+Bignum bignum_mul(Allocator *allocator, Bignum a, Bignum b) {
+    if (a.size == 0 || b.size == 0) {
+        return (Bignum){0};
+    }
+    if (a.size < b.size) {
+        Bignum t = a; a = b; b = t;
+    }
+
+    u32 *limbs = alloc_array(allocator, u32, a.size+b.size);
+    if (b.size < BIGNUM_KARATSUBA_THRESHOLD) {
+        limbs_mul_basecase(limbs, a.limbs, a.size, b.limbs, b.size);
+    } else {
+        // the intermediate results of the recursion are thrown away afterwards
+        Allocator tmp = init_allocator();
+        limbs_mul(&tmp, limbs, a.limbs, a.size, b.limbs, b.size);
+        free_allocator(&tmp);
+    }
+
+    Bignum result = bignum_view(limbs, a.size+b.size);
+    result.negative = a.negative != b.negative;
+    return result;
+}
+
+void bignum_divmod(Allocator *allocator, Bignum a, Bignum b, Bignum *quotient, Bignum *remainder) {
+    assert(b.size > 0); // zero division
+
+    Bignum q = {0};
+    Bignum r = a;
+    if (limbs_compare(a.limbs, a.size, b.limbs, b.size) >= 0) {
+        u32 *q_limbs = alloc_array(allocator, u32, a.size);
+        u32 *r_limbs = alloc_array(allocator, u32, b.size);
+        if (b.size == 1) {
+            r_limbs[0] = limbs_divmod_small(q_limbs, a.limbs, a.size, b.limbs[0]);
+        } else {
+            limbs_divmod(q_limbs, r_limbs, a.limbs, a.size, b.limbs, b.size);
+            memset(&q_limbs[a.size-b.size+1], 0, (b.size-1)*sizeof(u32));
+        }
+
+        q = bignum_view(q_limbs, a.size);
+        q.negative = q.size > 0 && a.negative != b.negative;
+        r = bignum_view(r_limbs, b.size);
+        r.negative = r.size > 0 && a.negative;
+    }
+
+    if (quotient != NULL) {
+        *quotient = q;
+    }
+    if (remainder != NULL) {
+        *remainder = r;
+    }
+}
+
+Bignum bignum_gcd(Allocator *allocator, Bignum a, Bignum b) {
+    a.negative = false;
+    b.negative = false;
+
+    // Euclid, every step only costs about one limb of the quotient times b
+    Allocator tmp = init_allocator();
+    while (b.size > 0) {
+        i64 x, y;
+        if (bignum_to_i64(a, &x) && bignum_to_i64(b, &y)) {
+            // the rest fits into machine words
+            while (y != 0) {
+                i64 t = x % y;
+                x = y;
+                y = t;
+            }
+            a = bignum_from_i64(&tmp, x);
+            break;
+        }
+
+        Bignum r;
+        bignum_divmod(&tmp, a, b, NULL, &r);
+        a = b;
+        b = r;
+    }
+
+    Bignum result = bignum_copy(allocator, a);
+    free_allocator(&tmp);
+    return result;
+}
+
+Bignum bignum_pow(Allocator *allocator, Bignum base, u64 exponent) {
+    Allocator tmp = init_allocator();
+    Bignum result = bignum_from_i64(&tmp, 1);
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result = bignum_mul(&tmp, result, base);
+        }
+        exponent >>= 1;
+        if (exponent > 0) {
+            base = bignum_mul(&tmp, base, base);
+        }
+    }
+    result = bignum_copy(allocator, result);
+    free_allocator(&tmp);
+    return result;
+}
+
+// floor(sqrt(a)) for a >= 0 by Newton's method, starting above the root so the
+// iterates decrease until they reach it
+Bignum bignum_isqrt(Allocator *allocator, Bignum a) {
+    assert(!a.negative);
+    if (a.size == 0) {
+        return a;
+    }
+
+    Allocator tmp = init_allocator();
+    usize bits = 32*a.size - count_leading_zeros(a.limbs[a.size-1]);
+    usize root_bits = (bits+1)/2;
+    u32 *limbs = alloc_array(&tmp, u32, root_bits/32 + 1);
+    memset(limbs, 0, (root_bits/32 + 1)*sizeof(u32));
+    limbs[root_bits/32] = 1u << (root_bits%32);
+    Bignum x = bignum_view(limbs, root_bits/32 + 1);
+
+    while (true) {
+        Bignum quotient;
+        bignum_divmod(&tmp, a, x, &quotient, NULL);
+        Bignum y = bignum_add(&tmp, x, quotient);
+        limbs_divmod_small(y.limbs, y.limbs, y.size, 2);
+        y = bignum_view(y.limbs, y.size);
+        if (bignum_compare(y, x) >= 0) {
+            break;
+        }
+        x = y;
+    }
+
+    Bignum result = bignum_copy(allocator, x);
+    free_allocator(&tmp);
+    return result;
+}
+
+// Only factors below SMALL_PRIMES_LIMIT are divided out of big numbers. If the rest still
+// doesn't fit into an u64 it is only checked for being a perfect square, a rest of
+// p^2*q with a big p keeps its square inside.
+void bignum_square_free(Allocator *allocator, Bignum n, Bignum *outside, Bignum *inside) {
+    assert(n.size > 0 && !n.negative);
+    Allocator tmp = init_allocator();
+    Bignum out = bignum_from_u64(&tmp, 1);
+    Bignum in = bignum_from_u64(&tmp, 1);
+
+    u32 *limbs = alloc_array(&tmp, u32, n.size);
+    u32 *quotient = alloc_array(&tmp, u32, n.size);
+    memcpy(limbs, n.limbs, n.size*sizeof(u32));
+    usize size = n.size;
+
+    // powers of two are a shift
+    usize zero_limbs = 0;
+    while (limbs[zero_limbs] == 0) {
+        zero_limbs += 1;
+    }
+    u32 zero_bits = __builtin_ctz(limbs[zero_limbs]);
+    u64 twos = 32*zero_limbs + zero_bits;
+    size -= zero_limbs;
+    memmove(limbs, &limbs[zero_limbs], size*sizeof(u32));
+    if (zero_bits > 0) {
+        for (usize i = 0; i < size; i++) {
+            limbs[i] = (limbs[i] >> zero_bits) | (i+1 < size ? limbs[i+1] << (32 - zero_bits) : 0);
+        }
+        size = limbs_normalize(limbs, size);
+    }
+    out = bignum_pow(&tmp, bignum_from_u64(&tmp, 2), twos/2);
+    if (twos & 1) {
+        in = bignum_from_u64(&tmp, 2);
+    }
+
+    usize count;
+    const u32 *primes = small_primes(&count);
+    for (usize i = 0; i < count && size > 2; i++) {
+        u32 p = primes[i];
+        if (limbs_divmod_small(quotient, limbs, size, p) != 0) {
+            continue;
+        }
+
+        // divide by the biggest power of p which fits into a limb first, so a
+        // huge exponent doesn't cost a pass over the whole number each
+        u32 power = p;
+        u32 power_exponent = 1;
+        while ((u64)power*p <= 0xffffffffu) {
+            power *= p;
+            power_exponent += 1;
+        }
+
+        u64 exponent = 0;
+        for (u32 d = power, e = power_exponent;; d /= p, e -= 1) {
+            while (limbs_divmod_small(quotient, limbs, size, d) == 0) {
+                u32 *t = limbs; limbs = quotient; quotient = t;
+                size = limbs_normalize(limbs, size);
+                exponent += e;
+            }
+            if (d == p) {
+                break;
+            }
+        }
+
+        out = bignum_mul(&tmp, out, bignum_pow(&tmp, bignum_from_u64(&tmp, p), exponent/2));
+        if (exponent & 1) {
+            in = bignum_mul_small(&tmp, in, p);
+        }
+    }
+
+    Bignum rest = bignum_view(limbs, size);
+    if (rest.size <= 2) {
+        u64 value = rest.size == 0 ? 0 : rest.size == 1 ? rest.limbs[0] : ((u64)rest.limbs[1] << 32) | rest.limbs[0];
+        u64 rest_outside, rest_inside;
+        u64_square_free(value, &rest_outside, &rest_inside);
+        out = bignum_mul(&tmp, out, bignum_from_u64(&tmp, rest_outside));
+        in = bignum_mul(&tmp, in, bignum_from_u64(&tmp, rest_inside));
+    } else {
+        Bignum root = bignum_isqrt(&tmp, rest);
+        if (bignum_compare(bignum_mul(&tmp, root, root), rest) == 0) {
+            out = bignum_mul(&tmp, out, root);
+        } else {
+            in = bignum_mul(&tmp, in, rest);
+        }
+    }
+
+    *outside = bignum_copy(allocator, out);
+    *inside = bignum_copy(allocator, in);
+    free_allocator(&tmp);
+}
+
+// Binary splitting: both halves have about the same size, so the big multiplications
+// at the top are balanced and use Karatsuba or Toom-3.
+Bignum bignum_range_product_rec(Allocator *allocator, u64 from, u64 to) {
+    if (to - from < 16) {
+        Bignum result = bignum_from_u64(allocator, 1);
+        for (u64 i = from; i <= to; i++) {
+            if (i <= 0xffffffffu) {
+                result = bignum_mul_small(allocator, result, (u32)i);
+            } else {
+                result = bignum_mul(allocator, result, bignum_from_u64(allocator, i));
+            }
+        }
+        return result;
+    }
+
+    u64 middle = from + (to - from)/2;
+    Bignum low = bignum_range_product_rec(allocator, from, middle);
+    Bignum high = bignum_range_product_rec(allocator, middle+1, to);
+    return bignum_mul(allocator, low, high);
+}
+
+Bignum bignum_range_product(Allocator *allocator, u64 from, u64 to) {
+    if (from > to) {
+        return bignum_from_u64(allocator, 1);
+    }
+    Allocator tmp = init_allocator();
+    Bignum result = bignum_copy(allocator, bignum_range_product_rec(&tmp, from, to));
+    free_allocator(&tmp);
+    return result;
+}
+
+//
+// factorials
+//
+
+// 20! is the last one which fits into an u64
+static const u64 SMALL_FACTORIALS[] = {
+    1ull, 1ull, 2ull, 6ull, 24ull, 120ull, 720ull, 5040ull, 40320ull, 362880ull, 3628800ull,
+    39916800ull, 479001600ull, 6227020800ull, 87178291200ull, 1307674368000ull,
+    20922789888000ull, 355687428096000ull, 6402373705728000ull, 121645100408832000ull,
+    2432902008176640000ull,
+};
+#define SMALL_FACTORIAL_MAX 20
+
+Bignum bignum_product_rec(Allocator *allocator, const u64 *values, usize count) {
+    if (count == 1) {
+        return bignum_from_u64(allocator, values[0]);
+    }
+    Bignum low = bignum_product_rec(allocator, values, count/2);
+    Bignum high = bignum_product_rec(allocator, &values[count/2], count - count/2);
+    return bignum_mul(allocator, low, high);
+}
+
+// product of the values, the pairs are formed by binary splitting so the big
+// multiplications are balanced
+Bignum bignum_product(Allocator *allocator, const u64 *values, usize count) {
+    if (count == 0) {
+        return bignum_from_u64(allocator, 1);
+    }
+    return bignum_product_rec(allocator, values, count);
+}
+
+// Collects prime powers into as few words as possible, every word is a factor of the
+// final product.
+typedef struct {
+    u64 *words;
+    usize count;
+    u64 word;
+} PrimeProduct;
+
+void prime_product_append(PrimeProduct *product, u64 factor) {
+    if (product->word > UINT64_MAX / factor) {
+        product->words[product->count++] = product->word;
+        product->word = 1;
+    }
+    product->word *= factor;
+}
+
+Bignum prime_product_finish(Allocator *allocator, PrimeProduct *product) {
+    if (product->word > 1) {
+        product->words[product->count++] = product->word;
+    }
+    return bignum_product(allocator, product->words, product->count);
+}
+
+// The swinging factorial n!/((n/2)!)^2 (Luschny). Every prime p <= n appears in it with
+// p^k <= n, the exponent has bit i set if n/p^i is odd. So it's a product of small
+// words, much smaller than n! itself.
+Bignum factorial_swing(Allocator *allocator, u64 n, const u32 *primes, usize count, u64 *words) {
+    PrimeProduct product = { words, 0, 1 };
+
+    // only the odd part, bignum_factorial shifts in the factors 2 at the end
+    for (usize i = 0; i < count && primes[i] <= n; i++) {
+        u64 p = primes[i];
+        u64 power = 1;
+        for (u64 q = n/p; q > 0; q /= p) {
+            if (q & 1) {
+                power *= p;
+            }
+        }
+        if (power > 1) {
+            prime_product_append(&product, power);
+        }
+    }
+
+    return prime_product_finish(allocator, &product);
+}
+
+// the odd part of n!, n! = ((n/2)!)^2 * swing(n) holds for the odd parts as well
+Bignum factorial_odd_rec(Allocator *allocator, u64 n, const u32 *primes, usize count, u64 *words) {
+    if (n <= SMALL_FACTORIAL_MAX) {
+        // odd part of the small factorial
+        u64 value = SMALL_FACTORIALS[n];
+        return bignum_from_u64(allocator, value >> __builtin_ctzll(value));
+    }
+    Bignum half = factorial_odd_rec(allocator, n/2, primes, count, words);
+    Bignum swing = factorial_swing(allocator, n, primes, count, words);
+    return bignum_mul(allocator, bignum_mul(allocator, half, half), swing);
+}
+
+Bignum bignum_factorial(Allocator *allocator, u64 n) {
+    if (n <= SMALL_FACTORIAL_MAX) {
+        return bignum_from_u64(allocator, SMALL_FACTORIALS[n]);
+    }
+
+    usize count;
+    u32 *primes = sieve_odd_primes(n, &count);
+    u64 *words = malloc((count+1)*sizeof(u64));
+    assert(words != NULL);
+
+    Allocator tmp = init_allocator();
+    Bignum odd = factorial_odd_rec(&tmp, n, primes, count, words);
+
+    // the exponent of 2 in n! is n - popcount(n) (Legendre)
+    u64 twos = n - __builtin_popcountll(n);
+    usize shift = twos/32;
+    u32 *limbs = alloc_array(allocator, u32, odd.size + shift + 1);
+    memset(limbs, 0, shift*sizeof(u32));
+    memcpy(&limbs[shift], odd.limbs, odd.size*sizeof(u32));
+    limbs[odd.size+shift] = limbs_mul_small(&limbs[shift], odd.size, 1u << (twos%32), 0);
+
+    free_allocator(&tmp);
+    free(words);
+    free(primes);
+    return bignum_view(limbs, odd.size + shift + 1);
+}
+
+//
+// binomials and permutations
+//
+
+// Rows 0 to 67 of Pascal's triangle, the biggest entry 67 choose 33 just fits into an
+// u64. Built once on first use from any thread, row n starts at index n(n+1)/2.
+#define PASCAL_MAX_N 67
+static u64 pascal_triangle[(PASCAL_MAX_N+1)*(PASCAL_MAX_N+2)/2];
+static pthread_once_t pascal_once = PTHREAD_ONCE_INIT;
+
+void pascal_build() {
+    for (usize row = 0; row <= PASCAL_MAX_N; row++) {
+        u64 *current = &pascal_triangle[row*(row+1)/2];
+        u64 *above = &pascal_triangle[(row-1)*row/2];
+        current[0] = current[row] = 1;
+        for (usize i = 1; i < row; i++) {
+            current[i] = above[i-1] + above[i];
+        }
+    }
+}
+
+u64 pascal_lookup(u64 n, u64 k) {
+    pthread_once(&pascal_once, pascal_build);
+    return pascal_triangle[n*(n+1)/2 + k];
+}
+
+u64 u64_gcd(u64 a, u64 b) {
+    while (b != 0) {
+        u64 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// n choose k multiplicatively, false if the result doesn't fit
+bool u64_binomial(u64 n, u64 k, u64 *result) {
+    // after step i the value is (n-k+i) choose i, an integer, so the division is exact
+    // once the common factor of value and i is cancelled
+    u64 value = 1;
+    for (u64 i = 1; i <= k; i++) {
+        u64 g = u64_gcd(value, i);
+        u64 factor = (n-k+i) / (i/g);
+        if (__builtin_mul_overflow(value/g, factor, &value)) {
+            return false;
+        }
+    }
+    *result = value;
+    return true;
+}
+
+// Kummer: p appears in n choose k once for every carry when adding k and n-k in base
+// p, and p^e <= n. So the big case is a product of small prime powers like n!.
+Bignum binomial_prime_product(Allocator *allocator, u64 n, u64 k) {
+    usize count;
+    u32 *primes = sieve_odd_primes(n, &count);
+    u64 *words = malloc((count+2)*sizeof(u64));
+    assert(words != NULL);
+    PrimeProduct product = { words, 0, 1 };
+
+    for (usize i = 0; i <= count; i++) {
+        u64 p = i == 0 ? 2 : primes[i-1];
+        u64 power = 1;
+        for (u64 a = n, b = k, c = n-k; a > 0; a /= p, b /= p, c /= p) {
+            if (a/p - b/p - c/p > 0) {
+                power *= p;
+            }
+        }
+        if (power > 1) {
+            prime_product_append(&product, power);
+        }
+    }
+
+    Allocator tmp = init_allocator();
+    Bignum result = bignum_copy(allocator, prime_product_finish(&tmp, &product));
+    free_allocator(&tmp);
+    free(words);
+    free(primes);
+    return result;
+}
+
+#define BINOMIAL_SIEVE_MAX (1u << 26)
+
+Bignum bignum_binomial(Allocator *allocator, u64 n, u64 k) {
+    assert(k <= n);
+    if (n - k < k) {
+        k = n - k;
+    }
+
+    u64 value;
+    if (n <= PASCAL_MAX_N) {
+        return bignum_from_u64(allocator, pascal_lookup(n, k));
+    } else if (u64_binomial(n, k, &value)) {
+        return bignum_from_u64(allocator, value);
+    } else if (n <= BINOMIAL_SIEVE_MAX) {
+        return binomial_prime_product(allocator, n, k);
+    }
+
+    // a sieve up to n would be too big, divide instead
+    Allocator tmp = init_allocator();
+    Bignum result;
+    bignum_divmod(&tmp, bignum_range_product(&tmp, n-k+1, n), bignum_factorial(&tmp, k), &result, NULL);
+    result = bignum_copy(allocator, result);
+    free_allocator(&tmp);
+    return result;
+}
+
+Bignum bignum_permutations(Allocator *allocator, u64 n, u64 k) {
+    // n!/(n-k)! = (n-k+1)*...*n, in machine words as long as it fits
+    assert(k <= n);
+    u64 value = 1;
+    for (u64 i = n-k+1; i <= n; i++) {
+        if (__builtin_mul_overflow(value, i, &value)) {
+            return bignum_range_product(allocator, n-k+1, n);
+        }
+    }
+    return bignum_from_u64(allocator, value);
+}
+
+#define DECIMAL_CHUNK 1000000000u // 10^9, the biggest power of ten in a limb
+#define DECIMAL_CHUNK_DIGITS 9
+
+Bignum bignum_from_string(Allocator *allocator, String digits) {
+    usize size = digits.size/DECIMAL_CHUNK_DIGITS + 2;
+    u32 *limbs = alloc_array(allocator, u32, size);
+    memset(limbs, 0, size*sizeof(u32));
+
+    usize used = 0;
+    for (usize i = 0; i < digits.size;) {
+        u32 chunk = 0;
+        u32 scale = 1;
+        for (usize j = 0; j < DECIMAL_CHUNK_DIGITS && i < digits.size; j++, i++) {
+            assert(digits.str[i] >= '0' && digits.str[i] <= '9');
+            chunk = chunk*10 + (digits.str[i]-'0');
+            scale *= 10;
+        }
+        u32 carry = limbs_mul_small(limbs, used, scale, chunk);
+        if (carry != 0) {
+            limbs[used++] = carry;
+        }
+    }
+
+    return bignum_view(limbs, used);
+}
+
+String bignum_to_string(Allocator *allocator, Bignum a) {
+    if (a.size == 0) {
+        return string_format(allocator, "0");
+    }
+
+    // split off 9 digits at a time, least significant first
+    u32 *magnitude = malloc(a.size*sizeof(u32));
+    u32 *chunks = malloc((a.size*10/9 + 2)*sizeof(u32));
+    assert(magnitude != NULL && chunks != NULL);
+    memcpy(magnitude, a.limbs, a.size*sizeof(u32));
+
+    usize size = a.size;
+    usize count = 0;
+    while (size > 0) {
+        chunks[count++] = limbs_divmod_small(magnitude, magnitude, size, DECIMAL_CHUNK);
+        size = limbs_normalize(magnitude, size);
+    }
+
+    String s = {0};
+    s.str = alloc_array(allocator, char, count*DECIMAL_CHUNK_DIGITS + 2);
+    s.size = sprintf(s.str, "%s%u", a.negative ? "-" : "", chunks[count-1]);
+    for (usize i = count-1; i > 0; i--) {
+        s.size += sprintf(&s.str[s.size], "%09u", chunks[i-1]);
+    }
+
+    free(chunks);
+    free(magnitude);
+    return s;
+}
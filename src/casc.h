@@ -1,9 +1,10 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stddef.h>
 
-#define MAX_VARIABLES 1024
 #define DEFAULT_LIST_CAPACITY 64
+#define MIN_AST_ARRAY_CAPACITY 4
 
 //
 // forward declarations
@@ -13,8 +14,12 @@ typedef struct AST AST;
 typedef struct Parser Parser;
 typedef struct Arena Arena;
 typedef struct Allocator Allocator;
+typedef struct ArenaMark ArenaMark;
+typedef struct AllocatorStats AllocatorStats;
 typedef struct String String;
 typedef struct Lexer Lexer;
+typedef struct Symbol Symbol;
+typedef struct ConsTable ConsTable;
 
 //
 // Basic Types
@@ -32,6 +37,66 @@ typedef size_t usize;
 typedef float f32;
 typedef double f64;
 
+//
+// allocator
+//
+
+// first arena of an allocator, every following one doubles in size up to ARENA_MAX_SIZE
+#define ARENA_MIN_SIZE (4*1024)
+#define ARENA_MAX_SIZE (1024*1024)
+#define ARENA_SIZE_CLASSES 9 // ARENA_MIN_SIZE << (ARENA_SIZE_CLASSES-1) == ARENA_MAX_SIZE
+// allocations bigger than this get a dedicated arena
+#define ARENA_LARGE_ALLOCATION (ARENA_MIN_SIZE*16)
+// upper bound for the memory of freed arenas which are kept for reuse
+#define ARENA_POOL_MAX_SIZE (16*1024*1024)
+#define ARENA_DEFAULT_ALIGNMENT _Alignof(max_align_t)
+
+struct Arena {
+    u8 *memory;
+    Arena *prev;
+
+    usize offset;
+    usize size;
+};
+
+struct Allocator {
+    Arena *arena; 
+
+    // optional, counters are only updated when this is set (see --stats)
+    AllocatorStats *stats;
+
+    // optional, when set structurally equal nodes are only allocated once (see --hash-consing)
+    ConsTable *cons;
+};
+
+// position in an allocator to rewind to, everything allocated after the mark gets freed
+struct ArenaMark {
+    Arena *arena;
+    Arena *prev;
+    usize offset;
+    usize cons_count;
+};
+
+Allocator init_allocator();
+void *alloc(Allocator *allocator, usize size);
+void *alloc_aligned(Allocator *allocator, usize size, usize align);
+void *alloc_resize(Allocator *allocator, void *memory, usize old_size, usize new_size, usize align);
+void free_allocator(Allocator *allocator);
+ArenaMark arena_mark(Allocator *allocator);
+void print_allocator_stats(const char *name, AllocatorStats *stats);
+void arena_pool_clear();
+usize arena_pool_size();
+void arena_rewind(Allocator *allocator, ArenaMark mark);
+
+#define alloc_type(allocator, type) ((type*)alloc_aligned(allocator, sizeof(type), _Alignof(type)))
+#define alloc_array(allocator, type, count) ((type*)alloc_aligned(allocator, sizeof(type)*(count), _Alignof(type)))
+#define resize_array(allocator, type, data, old_count, new_count) \
+    ((type*)alloc_resize(allocator, data, sizeof(type)*(old_count), sizeof(type)*(new_count), _Alignof(type)))
+
+//
+// string
+//
+
 struct String {
     char *str;
     usize size;
@@ -40,11 +105,100 @@ struct String {
 String init_string(const char *str);
 String char_to_string(Allocator *allocator, char c);
 String string_slice(Allocator *allocator, String s, usize start, usize stop);
+String string_view(String s, usize start, usize stop);
 String string_concat(Allocator *allocator, String s1, String s2);
 String string_insert(Allocator *allocator, String s1, String s2, usize idx);
 String string_insert_char(Allocator *allocator, String s1, char c, usize idx);
 bool string_eq(String s1, String s2);
+i64 string_to_i64(String s);
+f64 string_to_f64(String s);
 void print(String s);
+String string_format(Allocator *allocator, const char *format, ...);
+// appends to s, which holds capacity bytes and grows in place while it is the last
+// allocation of allocator
+void string_append_format(Allocator *allocator, String *s, usize *capacity, const char *format, ...);
+
+//
+// bignum
+//
+
+// Integer of any size. The magnitude is in base 2^32 limbs, least significant first,
+// without leading zero limbs, so zero has size 0 and is never negative. Bignums are
+// values, results are allocated in the given allocator and never modify an operand.
+typedef struct {
+    u32 *limbs;
+    u32 size;
+    bool negative;
+} Bignum;
+
+// multiplication switches from schoolbook to Karatsuba to Toom-3 at these sizes (limbs)
+#define BIGNUM_KARATSUBA_THRESHOLD 40
+#define BIGNUM_TOOM3_THRESHOLD 160
+// integer powers with a bigger result stay symbolic
+#define BIGNUM_MAX_POW_BITS (1 << 26)
+// factorials of bigger numbers stay symbolic, 2^21! has about as many bits as the biggest power
+#define BIGNUM_MAX_FACTORIAL (1 << 21)
+
+Bignum bignum_from_i64(Allocator*, i64);
+Bignum bignum_from_u64(Allocator*, u64);
+Bignum bignum_from_string(Allocator*, String digits);
+Bignum bignum_from_f64(Allocator*, f64); // the value has to be a whole number
+Bignum bignum_copy(Allocator*, Bignum);
+bool bignum_to_i64(Bignum, i64 *value); // false if it doesn't fit
+f64 bignum_to_f64(Bignum);
+String bignum_to_string(Allocator*, Bignum);
+u64 bignum_hash(Bignum);
+i32 bignum_compare(Bignum, Bignum);
+Bignum bignum_negate(Bignum);
+
+Bignum bignum_add(Allocator*, Bignum, Bignum);
+Bignum bignum_sub(Allocator*, Bignum, Bignum);
+Bignum bignum_mul(Allocator*, Bignum, Bignum);
+// truncating like C, the remainder has the sign of a, either output may be NULL
+void bignum_divmod(Allocator*, Bignum a, Bignum b, Bignum *quotient, Bignum *remainder);
+Bignum bignum_gcd(Allocator*, Bignum, Bignum); // always >= 0
+u64 u64_gcd(u64, u64);
+Bignum bignum_pow(Allocator*, Bignum, u64 exponent);
+Bignum bignum_isqrt(Allocator*, Bignum); // floor(sqrt(a)) for a >= 0
+Bignum bignum_range_product(Allocator*, u64 from, u64 to); // from*(from+1)*...*to
+Bignum bignum_product(Allocator*, const u64 *values, usize count);
+Bignum bignum_factorial(Allocator*, u64 n);
+Bignum bignum_binomial(Allocator*, u64 n, u64 k); // n choose k
+Bignum bignum_permutations(Allocator*, u64 n, u64 k); // n!/(n-k)!
+
+//
+// primes
+//
+
+// odd primes below this are tabled for trial division
+#define SMALL_PRIMES_LIMIT (1 << 16)
+// u64 factorization divides by primes below this before switching to Pollard's rho
+#define TRIAL_DIVISION_LIMIT 1024
+// steps of Pollard's rho between two gcds
+#define POLLARD_BATCH 128
+// factorizations which needed Pollard's rho are cached, a power of two
+#define FACTOR_CACHE_SIZE 1024
+// the largest prime below 2^64
+#define U64_MAX_PRIME 18446744073709551557ull
+// the product of the first 16 primes is already bigger than 2^64
+#define FACTORIZATION_MAX_PRIMES 15
+
+// distinct prime factors in increasing order with their exponents
+typedef struct {
+    u64 primes[FACTORIZATION_MAX_PRIMES];
+    u8 exponents[FACTORIZATION_MAX_PRIMES];
+    u32 count;
+} Factorization;
+
+u32 *sieve_odd_primes(u64 n, usize *count); // the caller frees the array
+const u32 *small_primes(usize *count); // odd primes below SMALL_PRIMES_LIMIT
+u64 u64_isqrt(u64);
+bool u64_is_prime(u64); // deterministic
+bool u64_next_prime(u64 n, u64 *prime); // the smallest prime > n, false if it is above 2^64
+Factorization u64_factor(u64); // n > 0, shared by sqrt and factor through the cache
+// n = outside^2 * inside with a square-free inside, n > 0
+void u64_square_free(u64 n, u64 *outside, u64 *inside);
+void bignum_square_free(Allocator*, Bignum n, Bignum *outside, Bignum *inside);
 
 //
 // lexer
@@ -79,11 +233,14 @@ typedef enum {
 
 typedef struct {
     TokenType type;
-    String text;
+    String text; // view into the lexer source, not null terminated
     
     // TODO: replace this and the occurences with string method
     //       string_contains
     bool contains_dot;
+
+    // interned text of TOKEN_IDENTIFIER tokens
+    Symbol *symbol;
 } Token;
 
 struct Lexer {
@@ -93,30 +250,92 @@ struct Lexer {
 };
 
 char lexer_current_char(Lexer*);
-Token lexer_peek_token(Lexer*);
 Token lexer_next_token(Lexer*);
 void lexer_print_tokens(Lexer*);
 
 const char* token_type_to_string(TokenType);
 
-bool is_builtin_function(String);
-bool is_builtin_constant(String);
+//
+// symbols
+//
+
+typedef enum {
+    BUILTIN_NONE,
+
+    BUILTIN_POW,
+    BUILTIN_EXP,
+    BUILTIN_SQRT,
+    BUILTIN_SIN,
+    BUILTIN_COS,
+    BUILTIN_TAN,
+    BUILTIN_ASIN,
+    BUILTIN_ACOS,
+    BUILTIN_ATAN,
+    BUILTIN_LN,
+    BUILTIN_LOG,
+    BUILTIN_ABS,
+    BUILTIN_FACTORIAL,
+    BUILTIN_NPR,
+    BUILTIN_NCR,
+    BUILTIN_GCD,
+    BUILTIN_LCM,
+    BUILTIN_FACTOR,
+    BUILTIN_ISPRIME,
+    BUILTIN_NEXTPRIME,
+    BUILTIN_DIFF,
+    BUILTIN_CEIL,
+    BUILTIN_FLOOR,
+    BUILTIN_SUM,
+    BUILTIN_PROD,
+    BUILTIN_SIMPLIFY,
+
+    BUILTIN_FUNCTION_COUNT
+} BuiltinFunction;
+
+typedef enum {
+    CONSTANT_NONE,
+
+    CONSTANT_PI,
+    CONSTANT_E,
+
+    BUILTIN_CONSTANT_COUNT
+} BuiltinConstant;
+
+// Every identifier is interned once, so two symbols with the same name always share
+// the same Symbol and the same name.str pointer. Comparing names is a pointer compare.
+struct Symbol {
+    String name; // owned by the symbol table, null terminated
+    u64 hash;
+
+    BuiltinFunction function;
+    BuiltinConstant constant;
+};
+
+Symbol *intern(String name);
+void free_symbol_table();
+u64 string_hash(String);
+
+const char *builtin_function_to_string(BuiltinFunction);
+const char *builtin_constant_to_string(BuiltinConstant);
 
 //
 // ast
 //
 
 #define INTEGER(value) init_ast_integer(ip->allocator, value)
+#define BIGINT(value) init_ast_bigint(ip->allocator, value)
+#define RATIONAL(numerator, denominator) init_ast_rational(ip->allocator, numerator, denominator)
+#define FACTORED(product) init_ast_factored(ip->allocator, product)
 #define REAL(value) init_ast_real(ip->allocator, value)
 #define SYMBOL(name) init_ast_symbol(ip->allocator, name)
-#define CONSTANT(name) init_ast_constant(ip->allocator, name)
+#define CONSTANT(id) init_ast_constant(ip->allocator, id)
 #define ADD(left, right) init_ast_binop(ip->allocator, left, right, OP_ADD)
 #define SUB(left, right) init_ast_binop(ip->allocator, left, right, OP_SUB)
 #define MUL(left, right) init_ast_binop(ip->allocator, left, right, OP_MUL)
 #define DIV(left, right) init_ast_binop(ip->allocator, left, right, OP_DIV)
 #define MOD(left, right) init_ast_binop(ip->allocator, left, right, OP_MOD)
 #define POW(left, right) init_ast_binop(ip->allocator, left, right, OP_POW)
-#define CALL(name, args) init_ast_call(ip->allocator, name, args)
+#define CALL(function, args) init_ast_call(ip->allocator, function, args)
 #define ASSIGN(target, value) init_ast_assign(ip->allocator, target, value)
 #define LIST(capacity) init_ast_list(ip->allocator, capacity)
 #define EMPTY() init_ast_empty(ip->allocator)
@@ -141,6 +360,9 @@ typedef enum {
     AST_PROGRAM,
 
     AST_INTEGER,
+    AST_BIGINT,
+    AST_RATIONAL,
+    AST_FACTORED,
     AST_REAL,
     AST_SYMBOL,
     AST_CONSTANT,
@@ -156,6 +378,28 @@ typedef enum {
     AST_TYPE_COUNT
 } ASTType;
 
+struct AllocatorStats {
+    usize allocations;
+    usize large_allocations;
+    usize resized_in_place;
+
+    usize requested_bytes;
+    usize padding_bytes; // lost to alignment
+
+    usize arenas_count;
+    usize arenas_created; // from malloc, chunks reused from the pool don't count
+    usize arenas_reused;
+
+    // used is everything handed out including padding, reserved is what we got from malloc
+    usize used_bytes;
+    usize peak_used_bytes;
+    usize reserved_bytes;
+    usize peak_reserved_bytes;
+
+    usize nodes[AST_TYPE_COUNT];
+    usize cons_hits; // nodes which were shared instead of allocated
+};
+
 struct ASTArray {
     usize capacity;
     usize size;
@@ -164,22 +408,33 @@ struct ASTArray {
 
 struct AST {
     ASTType type;
+    u64 hash; // structural, equal trees always have equal hashes
     union {
 
         struct {
             i64 value;
         } integer;
 
+        struct {
+            Bignum value; // never fits into an i64, those are always AST_INTEGER
+        } bigint;
+
+        // always reduced with a denominator > 1, both are AST_INTEGER or AST_BIGINT
+        struct {
+            AST *numerator;
+            AST *denominator;
+        } rational;
+
         struct {
             f64 value;
         } real;
 
         struct {
-            String name;
+            String name; // always interned, see Symbol
         } symbol;
 
         struct {
-            String name;
+            BuiltinConstant id;
         } constant;
 
         struct {
@@ -194,7 +449,7 @@ struct AST {
         } unaryop;
 
         struct {
-            String name;
+            BuiltinFunction function;
             ASTArray args;
         } func_call;
 
@@ -211,22 +466,55 @@ struct AST {
             ASTArray nodes;
         } list;
 
+        // p1^e1*...*pk^ek from factor(), arithmetic treats it like a symbol so it keeps this form
+        struct {
+            AST *product;
+        } factored;
+
         bool empty; // TODO: temporary for ASTType empty
     };
 };
 
+// integers in this range are shared static nodes and never allocated
+#define SMALL_INTEGER_MIN (-256)
+#define SMALL_INTEGER_MAX 1024
+
 AST *init_ast_list(Allocator*, usize capacity);
 AST *init_ast_program(Allocator*);
 AST *init_ast_assign(Allocator*, AST *target, AST *value);
 AST *init_ast_integer(Allocator*, i64);
+AST *init_ast_bigint(Allocator*, Bignum); // gives an AST_INTEGER if the value fits
+AST *init_ast_rational(Allocator*, AST *numerator, AST *denominator); // see interp_rational
+AST *init_ast_factored(Allocator*, AST *product); // see interp_factor
 AST *init_ast_real(Allocator*, f64);
 AST *init_ast_symbol(Allocator*, String);
-AST *init_ast_constant(Allocator*, String);
+AST *init_ast_constant(Allocator*, BuiltinConstant);
 AST *init_ast_binop(Allocator*, AST*, AST*, OpType);
 AST *init_ast_unaryop(Allocator*, AST*, OpType);
-AST *init_ast_call(Allocator*, String, ASTArray);
+AST *init_ast_call(Allocator*, BuiltinFunction, ASTArray);
 AST *init_ast_empty(Allocator*);
 
+// Hash-consing table of an allocator. Integers, reals, symbols, constants, binops,
+// unaryops and calls are looked up here before they get allocated, lists, programs
+// and assigns are never shared.
+struct ConsTable {
+    // open addressing with linear probing, capacity is a power of 2
+    AST **nodes;
+    usize capacity;
+    usize count;
+
+    // all nodes in insertion order, so a rewind can take back the newest ones
+    AST **log;
+    usize log_capacity;
+};
+
+u64 hash_combine(u64 hash, u64 value);
+u64 ast_hash(AST*);
+AST *cons_table_find(ConsTable*, AST *key);
+void cons_table_insert(ConsTable*, AST*);
+void cons_table_rewind(ConsTable*, usize count);
+void free_cons_table(ConsTable*);
+
 ASTArray init_ast_array_with_capacity(Allocator*, usize capacity);
 void ast_array_append(Allocator*, ASTArray*, AST*);
 
@@ -235,66 +523,248 @@ const char *op_type_to_string(OpType);
 const char *ast_type_to_debug_string(ASTType);
 uint8_t op_type_precedence(OpType);
 
+AST *ast_copy(Allocator*, AST*);
 ASTArray ast_to_flat_array(Allocator*, AST*);
 bool ast_contains(AST*, AST*);
-bool ast_is_fraction(AST*);
 bool ast_is_numeric(AST*);
+bool ast_is_integer(AST*); // AST_INTEGER or AST_BIGINT
+bool ast_is_rational(AST*); // an integer or AST_RATIONAL
+Bignum ast_to_bignum(Allocator*, AST*);
+bool ast_to_u64(AST*, u64 *value); // false unless a non-negative integer below 2^64
 
 f64 ast_to_f64(AST*);
 
 void list_append(Allocator*, AST *list, AST *node); 
 
+// Immortal nodes for common constants. They live in static memory, never get freed and
+// can be shared by all allocators, so returning or comparing against them is free.
+extern AST ast_zero;
+extern AST ast_one;
+extern AST ast_minus_one;
+extern AST ast_two;
+extern AST ast_pi;
+extern AST ast_e;
+
+//
+// patterns
+//
+
+typedef enum {
+    PATTERN_ANY,
+    PATTERN_ANY_INTEGER,
+    PATTERN_INTEGER, // integer with exactly this value
+    PATTERN_CONSTANT,
+    PATTERN_BINOP,
+    PATTERN_UNARYOP,
+    PATTERN_CALL,
+} PatternType;
+
+#define PATTERN_MAX_SLOTS 4
+#define PATTERN_MAX_ARGS 2
+
+typedef struct Pattern Pattern;
+struct Pattern {
+    PatternType type;
+    u8 slot; // the matched node is stored in bindings[slot], 0 means not bound
+
+    union {
+        i64 value;
+        BuiltinConstant constant;
+
+        struct {
+            OpType op;
+            Pattern *left;
+            Pattern *right;
+        } binop;
+
+        struct {
+            OpType op;
+            Pattern *operand;
+        } unaryop;
+
+        struct {
+            BuiltinFunction function;
+            Pattern *args[PATTERN_MAX_ARGS]; // the call has exactly as many args as are set
+        } call;
+    };
+};
+
+// Patterns are compound literals, at file scope these live in static memory. If the same
+// slot is used twice the second node has to match the first one (e.g. x^n * x).
+#define MATCH_ANY(n) (&(Pattern){ .type = PATTERN_ANY, .slot = (n) })
+#define MATCH_ANY_INTEGER(n) (&(Pattern){ .type = PATTERN_ANY_INTEGER, .slot = (n) })
+#define MATCH_INTEGER(n) (&(Pattern){ .type = PATTERN_INTEGER, .value = (n) })
+#define MATCH_CONSTANT(constant_id) (&(Pattern){ .type = PATTERN_CONSTANT, .constant = (constant_id) })
+#define MATCH_BINOP(binop_op, left_pattern, right_pattern) (&(Pattern){ .type = PATTERN_BINOP, .binop = { (binop_op), (left_pattern), (right_pattern) } })
+#define MATCH_UNARYOP(unaryop_op, operand_pattern) (&(Pattern){ .type = PATTERN_UNARYOP, .unaryop = { (unaryop_op), (operand_pattern) } })
+#define MATCH_CALL(call_function, ...) (&(Pattern){ .type = PATTERN_CALL, .call = { (call_function), { __VA_ARGS__ } } })
+
+// bindings has to be zeroed (or NULL if the pattern has no slots), after a failed match
+// it may contain partial bindings
+bool pattern_match(Pattern*, AST*, AST **bindings);
+// builds the tree of a pattern, slots are replaced by their bindings
+AST *pattern_build(Allocator*, Pattern*, AST **bindings);
+
 //
 // parser
 //
 
+struct Parser {
+    Allocator *allocator;
+
+    // all tokens of the source, the last one is always TOKEN_EOF
+    Token *tokens;
+    usize tokens_count;
+    usize pos;
+};
+
 AST* parse(Lexer*);
-AST* parse_expr(Lexer*);
-AST* parse_factor(Lexer*);
+AST* parse_expr(Parser*);
+AST* parse_factor(Parser*);
 
 //
 // interp
 //
 
+// bit n of args_counts is set when the function accepts n arguments
+#define ARGS(n) (1u << (n))
+
 typedef struct FunctionSignature FunctionSignature;
 struct FunctionSignature {
     // TODO: really not possible to use our own String type here?
     const char *name;
-
-    // maybe we change this to i32 in the future to encode 
-    // variadic amount of args with something like -1.
-    usize args_count;
+    u32 args_counts;
 };
 
-extern const FunctionSignature BUILTIN_FUNCTIONS[];
-extern const usize BUILTIN_FUNCTIONS_COUNT;
-
-extern const char *BUILTIN_CONSTANTS[];
-extern const usize BUILTIN_CONSTANTS_COUNT;
+// both indexed by their id
+extern const FunctionSignature BUILTIN_FUNCTIONS[BUILTIN_FUNCTION_COUNT];
+extern const char *BUILTIN_CONSTANTS[BUILTIN_CONSTANT_COUNT];
 
 typedef struct  {
-    String name;
+    String name; // interned, NULL for a free slot
     AST *value;
 } Variable;
 
+typedef struct Environment Environment;
+struct Environment {
+    Environment *parent; // enclosing scope, NULL for the global scope
+
+    // open addressing with linear probing, capacity is a power of 2
+    Variable *variables;
+    usize capacity;
+    usize count;
+};
+
+// Maps a subtree to its simplified result. Keys and results are copied into the cache's
+// own allocator, so they survive the statement and repeated subexpressions (or repeated
+// cells in the gui) are only evaluated once.
+#define MEMO_MAX_ENTRIES 4096
+// Keys and results are copied, so only trees up to this many nodes are cached. Copying
+// every level of a deeply nested input would be quadratic in its depth.
+#define MEMO_MAX_NODES 128
+
 typedef struct {
+    AST *key;
+    AST *value;
+} MemoEntry;
+
+typedef struct {
+    Allocator allocator;
+
+    // open addressing with linear probing, 2*MEMO_MAX_ENTRIES slots allocated on first use
+    MemoEntry *entries;
+    usize count;
+
+    // Results handed out during a statement can still be in use, so the memory of an
+    // invalidated (or full) cache is only freed after the statement.
+    bool stale;
+
+    usize hits;
+    usize misses;
+} MemoCache;
+
+typedef struct {
+    // Results and variable values live in this allocator. While a statement is
+    // evaluated it points to scratch and the original one is in persistent_allocator.
     Allocator *allocator;
+    Allocator *persistent_allocator;
+    Allocator scratch;
+    ConsTable scratch_cons; // used by scratch when the allocator does hash-consing
+
+    Environment globals;
+    Environment *scope; // innermost scope, NULL when we are in the global scope
 
-    // TODO: maybe put the variables on the heap
-    Variable variables[MAX_VARIABLES];
-    usize variables_count;
+    MemoCache memo;
 } Interp;
 
 AST *interp(Interp*, AST*);
+void free_interp(Interp*);
+void interp_push_scope(Interp*);
+void interp_pop_scope(Interp*);
+void memo_invalidate(MemoCache*);
+
+AST *environment_get(Environment*, String name);
+void environment_set(Environment*, String name, AST *value);
+void free_environment(Environment*);
+
+AST *interp_real(Interp*, f64);
+AST *interp_u64(Interp*, u64);
+bool i64_pow(i64 base, i64 exponent, i64 *result); // exponent >= 0, false on overflow
+AST *interp_rational(Interp*, AST *numerator, AST *denominator); // reduced, an integer if it can be
 AST *interp_binop_pow(Interp*, AST*, AST*);
 
 bool ast_match(AST*, AST*);
 bool ast_match_type(AST*, AST*);
+i32 ast_compare(AST*, AST*);
 
 String _ast_to_string(Allocator*, AST*, u8);
 #define ast_to_string(allocator, node) _ast_to_string(allocator, node, 0)
 String ast_to_debug_string(Allocator*, AST*);
 
+//
+// rewrite
+//
+
+// A simplification rule as data: every node matching pattern is replaced by the tree
+// of replacement, built with the bindings of the match. Rules are indexed by the shape
+// of their pattern in a discrimination tree, see RULES in rewrite.c.
+typedef struct {
+    const char *name;
+    Pattern *pattern;
+    Pattern *replacement;
+} RewriteRule;
+
+// upper bound for rule applications of one rewrite, so cyclic rules can't hang
+#define REWRITE_MAX_STEPS 10000
+
+// Checks the root of node, whose children interp has already evaluated. A replacement is
+// rewritten further with the worklist until no rule applies. Returns NULL if no rule
+// applies, node itself is never returned or stored, so it can live on the stack.
+AST *rewrite_node(Interp*, AST*);
+
+//
+// egraph
+//
+
+// Equality saturation stops at whichever limit is hit first.
+typedef struct {
+    usize max_iterations;
+    usize max_nodes;
+} EGraphBudget;
+
+#define EGRAPH_DEFAULT_BUDGET ((EGraphBudget){ .max_iterations = 32, .max_nodes = 20000 })
+
+typedef struct {
+    usize iterations;
+    usize nodes;
+    usize classes;
+    bool saturated; // no rule added anything new, the result is the smallest form the rules can reach
+} EGraphStats;
+
+// smallest (by node count) expression equal to node under the rules in egraph.c,
+// stats is optional
+AST *egraph_simplify(Interp*, AST*, EGraphBudget, EGraphStats *stats);
+
 //
 // gui
 //
@@ -308,21 +778,3 @@ void init_gui();
 #define panic(msg) fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, msg); exit(1);
 #define todo() panic("not implemented");
 #define mark(i) printf("... MARK %d\n", i); 
-
-struct Arena {
-    void *memory;
-    Arena *prev;
-
-    usize offset;
-
-    // TODO: when arena size is always the same we dont need this one
-    usize size;
-};
-
-struct Allocator {
-    Arena *arena; 
-};
-
-Allocator init_allocator();
-void *alloc(Allocator *allocator, usize size);
-void free_allocator(Allocator *allocator);
@@ -0,0 +1,643 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "casc.h"
+
+// An e-graph stores many equal expressions at once. Every e-node belongs to an e-class
+// (a set of equal nodes) and its children are e-classes, not nodes. Rules only ever
+// add nodes and merge classes, so unlike greedy rewriting nothing gets lost and the
+// order of the rules doesn't matter. When the rules are done (or the budget is used
+// up) the smallest tree is extracted from the class of the input.
+
+// Rules hold in both directions, rules which make an expression bigger (like
+// distributing) are fine, extraction picks the smallest form anyway.
+static struct {
+    const char *name;
+    Pattern *left;
+    Pattern *right;
+} EGRAPH_RULES[] = {
+    { "a+b = b+a", MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_ANY(2)), MATCH_BINOP(OP_ADD, MATCH_ANY(2), MATCH_ANY(1)) },
+    { "a*b = b*a", MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(2)), MATCH_BINOP(OP_MUL, MATCH_ANY(2), MATCH_ANY(1)) },
+    { "(a+b)+c = a+(b+c)", MATCH_BINOP(OP_ADD, MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_ANY(2)), MATCH_ANY(3)), MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_BINOP(OP_ADD, MATCH_ANY(2), MATCH_ANY(3))) },
+    { "a+(b+c) = (a+b)+c", MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_BINOP(OP_ADD, MATCH_ANY(2), MATCH_ANY(3))), MATCH_BINOP(OP_ADD, MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_ANY(2)), MATCH_ANY(3)) },
+    { "(a*b)*c = a*(b*c)", MATCH_BINOP(OP_MUL, MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(2)), MATCH_ANY(3)), MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_BINOP(OP_MUL, MATCH_ANY(2), MATCH_ANY(3))) },
+    { "a*(b*c) = (a*b)*c", MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_BINOP(OP_MUL, MATCH_ANY(2), MATCH_ANY(3))), MATCH_BINOP(OP_MUL, MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(2)), MATCH_ANY(3)) },
+    { "a-b = a+(-1)*b", MATCH_BINOP(OP_SUB, MATCH_ANY(1), MATCH_ANY(2)), MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_BINOP(OP_MUL, MATCH_INTEGER(-1), MATCH_ANY(2))) },
+    { "a+(-1)*b = a-b", MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_BINOP(OP_MUL, MATCH_INTEGER(-1), MATCH_ANY(2))), MATCH_BINOP(OP_SUB, MATCH_ANY(1), MATCH_ANY(2)) },
+    { "a+n = a-(-n)", MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_ANY_INTEGER(2)), MATCH_BINOP(OP_SUB, MATCH_ANY(1), MATCH_UNARYOP(OP_USUB, MATCH_ANY(2))) },
+    { "-a = (-1)*a", MATCH_UNARYOP(OP_USUB, MATCH_ANY(1)), MATCH_BINOP(OP_MUL, MATCH_INTEGER(-1), MATCH_ANY(1)) },
+    { "(-1)*a = -a", MATCH_BINOP(OP_MUL, MATCH_INTEGER(-1), MATCH_ANY(1)), MATCH_UNARYOP(OP_USUB, MATCH_ANY(1)) },
+    { "+a = a", MATCH_UNARYOP(OP_UADD, MATCH_ANY(1)), MATCH_ANY(1) },
+    { "a+0 = a", MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_INTEGER(0)), MATCH_ANY(1) },
+    { "a*1 = a", MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_INTEGER(1)), MATCH_ANY(1) },
+    { "a*0 = 0", MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_INTEGER(0)), MATCH_INTEGER(0) },
+    { "a/1 = a", MATCH_BINOP(OP_DIV, MATCH_ANY(1), MATCH_INTEGER(1)), MATCH_ANY(1) },
+    { "a+a = 2*a", MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_ANY(1)), MATCH_BINOP(OP_MUL, MATCH_INTEGER(2), MATCH_ANY(1)) },
+    { "a*x+x = (a+1)*x", MATCH_BINOP(OP_ADD, MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(2)), MATCH_ANY(2)), MATCH_BINOP(OP_MUL, MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_INTEGER(1)), MATCH_ANY(2)) },
+    { "a*x+b*x = (a+b)*x", MATCH_BINOP(OP_ADD, MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(2)), MATCH_BINOP(OP_MUL, MATCH_ANY(3), MATCH_ANY(2))), MATCH_BINOP(OP_MUL, MATCH_BINOP(OP_ADD, MATCH_ANY(1), MATCH_ANY(3)), MATCH_ANY(2)) },
+    { "a*(b+c) = a*b+a*c", MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_BINOP(OP_ADD, MATCH_ANY(2), MATCH_ANY(3))), MATCH_BINOP(OP_ADD, MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(2)), MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(3))) },
+    { "x*x = x^2", MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(1)), MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_INTEGER(2)) },
+    { "x^2 = x*x", MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_INTEGER(2)), MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(1)) },
+    { "x^a*x = x^(a+1)", MATCH_BINOP(OP_MUL, MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_ANY(2)), MATCH_ANY(1)), MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_BINOP(OP_ADD, MATCH_ANY(2), MATCH_INTEGER(1))) },
+    { "x^a*x^b = x^(a+b)", MATCH_BINOP(OP_MUL, MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_ANY(2)), MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_ANY(3))), MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_BINOP(OP_ADD, MATCH_ANY(2), MATCH_ANY(3))) },
+    { "x^1 = x", MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_INTEGER(1)), MATCH_ANY(1) },
+    { "x^0 = 1", MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_INTEGER(0)), MATCH_INTEGER(1) },
+};
+
+#define EGRAPH_RULES_COUNT (sizeof(EGRAPH_RULES)/sizeof(EGRAPH_RULES[0]))
+
+#define ECLASS_NONE 0xffffffffu
+
+// Integers, reals, symbols and constants are leaves and keep their AST. Everything the
+// rules don't know (lists, calls with more args, ...) is an opaque leaf as well.
+typedef struct {
+    u8 type; // ASTType
+    u8 tag; // OpType or BuiltinFunction
+    u8 arity;
+    bool duplicate; // same as another node of its class since the last rebuild
+    u32 children[2];
+    AST *leaf;
+} ENode;
+
+typedef struct {
+    Allocator *allocator; // for leaves created by constant folding
+
+    // A new node starts its own class with the same id, so the union-find parents
+    // are indexed like the nodes.
+    ENode *nodes;
+    u32 *parents;
+    bool *has_value; // the class is known to be this integer
+    i64 *values;
+    usize count;
+    usize capacity;
+
+    // canonical node -> node id, open addressing, capacity is a power of 2
+    u32 *table;
+    usize table_capacity;
+
+    // members of every class, class_members[class_offsets[c]..class_offsets[c+1]]
+    u32 *class_offsets;
+    u32 *class_members;
+
+    usize unions; // merges since the last rebuild
+} EGraph;
+
+u32 eclass_find(EGraph *g, u32 class) {
+    while (g->parents[class] != class) {
+        g->parents[class] = g->parents[g->parents[class]]; // path halving
+        class = g->parents[class];
+    }
+    return class;
+}
+
+bool eclass_union(EGraph *g, u32 a, u32 b) {
+    a = eclass_find(g, a);
+    b = eclass_find(g, b);
+    if (a == b) {
+        return false;
+    }
+
+    // the older class stays the root
+    if (b < a) {
+        u32 t = a; a = b; b = t;
+    }
+    g->parents[b] = a;
+    if (!g->has_value[a] && g->has_value[b]) {
+        g->has_value[a] = true;
+        g->values[a] = g->values[b];
+    }
+    g->unions += 1;
+    return true;
+}
+
+u64 enode_hash(EGraph *g, ENode *node) {
+    u64 hash = hash_combine(1, node->type);
+    hash = hash_combine(hash, node->tag);
+    for (usize i = 0; i < node->arity; i++) {
+        hash = hash_combine(hash, eclass_find(g, node->children[i]));
+    }
+    if (node->leaf != NULL) {
+        hash = hash_combine(hash, node->leaf->hash);
+    }
+    return hash;
+}
+
+bool enode_eq(EGraph *g, ENode *a, ENode *b) {
+    if (a->type != b->type || a->tag != b->tag || a->arity != b->arity) {
+        return false;
+    }
+    for (usize i = 0; i < a->arity; i++) {
+        if (eclass_find(g, a->children[i]) != eclass_find(g, b->children[i])) {
+            return false;
+        }
+    }
+    return a->leaf == b->leaf || (a->leaf != NULL && b->leaf != NULL && ast_match(a->leaf, b->leaf));
+}
+
+// slot of node in the table, either the equal node or an empty slot
+u32 *egraph_table_slot(EGraph *g, ENode *node) {
+    usize mask = g->table_capacity-1;
+    usize i = enode_hash(g, node) & mask;
+    while (g->table[i] != ECLASS_NONE && !enode_eq(g, &g->nodes[g->table[i]], node)) {
+        i = (i+1) & mask;
+    }
+    return &g->table[i];
+}
+
+void egraph_table_reset(EGraph *g, usize min_count) {
+    usize capacity = g->table_capacity == 0 ? 256 : g->table_capacity;
+    while (4*min_count >= 3*capacity) {
+        capacity *= 2;
+    }
+    if (capacity != g->table_capacity) {
+        free(g->table);
+        g->table = malloc(capacity*sizeof(u32));
+        assert(g->table != NULL);
+        g->table_capacity = capacity;
+    }
+    memset(g->table, 0xff, capacity*sizeof(u32));
+}
+
+// value of an op on integer classes, false if it isn't an integer (or would overflow)
+bool enode_fold(EGraph *g, ENode *node, i64 *result) {
+    if (node->type == AST_INTEGER) {
+        *result = node->leaf->integer.value;
+        return true;
+    }
+
+    i64 v[2];
+    for (usize i = 0; i < node->arity; i++) {
+        u32 child = eclass_find(g, node->children[i]);
+        if (!g->has_value[child]) {
+            return false;
+        }
+        v[i] = g->values[child];
+    }
+
+    if (node->type == AST_UNARYOP) {
+        if (node->tag == OP_UADD) {
+            *result = v[0];
+            return true;
+        }
+        return !__builtin_sub_overflow((i64)0, v[0], result);
+    } else if (node->type != AST_BINOP) {
+        return false;
+    }
+
+    switch (node->tag) {
+        case OP_ADD: return !__builtin_add_overflow(v[0], v[1], result);
+        case OP_SUB: return !__builtin_sub_overflow(v[0], v[1], result);
+        case OP_MUL: return !__builtin_mul_overflow(v[0], v[1], result);
+        case OP_DIV: {
+            if (v[1] == 0 || (v[0] == INT64_MIN && v[1] == -1) || v[0] % v[1] != 0) {
+                return false;
+            }
+            *result = v[0] / v[1];
+            return true;
+        }
+        case OP_POW: {
+            if (v[1] < 0) {
+                return false;
+            }
+            return i64_pow(v[0], v[1], result);
+        }
+        default: return false;
+    }
+}
+
+u32 egraph_add(EGraph *g, ENode node) {
+    for (usize i = 0; i < node.arity; i++) {
+        node.children[i] = eclass_find(g, node.children[i]);
+    }
+
+    u32 *slot = egraph_table_slot(g, &node);
+    if (*slot != ECLASS_NONE) {
+        return eclass_find(g, *slot);
+    }
+
+    if (g->count == g->capacity) {
+        g->capacity = g->capacity == 0 ? 256 : g->capacity*2;
+        g->nodes = realloc(g->nodes, g->capacity*sizeof(ENode));
+        g->parents = realloc(g->parents, g->capacity*sizeof(u32));
+        g->has_value = realloc(g->has_value, g->capacity*sizeof(bool));
+        g->values = realloc(g->values, g->capacity*sizeof(i64));
+        assert(g->nodes != NULL && g->parents != NULL && g->has_value != NULL && g->values != NULL);
+    }
+
+    u32 id = g->count++;
+    g->nodes[id] = node;
+    g->parents[id] = id;
+    g->has_value[id] = enode_fold(g, &node, &g->values[id]);
+    *slot = id;
+
+    if (4*g->count >= 3*g->table_capacity) {
+        egraph_table_reset(g, g->count);
+        for (u32 i = 0; i < g->count; i++) {
+            *egraph_table_slot(g, &g->nodes[i]) = i;
+        }
+    }
+
+    // constant folding, the class gets the integer leaf as well
+    if (g->has_value[id] && node.type != AST_INTEGER) {
+        AST *leaf = init_ast_integer(g->allocator, g->values[id]);
+        eclass_union(g, id, egraph_add(g, (ENode){ .type = AST_INTEGER, .leaf = leaf }));
+    }
+
+    return eclass_find(g, id);
+}
+
+u32 egraph_add_ast(EGraph *g, AST *node) {
+    switch (node->type) {
+        case AST_BINOP: {
+            u32 left = egraph_add_ast(g, node->binop.left);
+            u32 right = egraph_add_ast(g, node->binop.right);
+            return egraph_add(g, (ENode){ .type = AST_BINOP, .tag = node->binop.op, .arity = 2, .children = { left, right } });
+        }
+        case AST_UNARYOP: {
+            u32 operand = egraph_add_ast(g, node->unaryop.operand);
+            return egraph_add(g, (ENode){ .type = AST_UNARYOP, .tag = node->unaryop.op, .arity = 1, .children = { operand } });
+        }
+        case AST_CALL: {
+            usize arity = node->func_call.args.size;
+            if (arity == 0 || arity > 2) {
+                break;
+            }
+            ENode call = { .type = AST_CALL, .tag = node->func_call.function, .arity = arity };
+            for (usize i = 0; i < arity; i++) {
+                call.children[i] = egraph_add_ast(g, node->func_call.args.data[i]);
+            }
+            return egraph_add(g, call);
+        }
+        default: break;
+    }
+    return egraph_add(g, (ENode){ .type = node->type, .leaf = node });
+}
+
+// Restores the invariants after unions: nodes whose children got merged may now be
+// equal to another node, so their classes have to be merged too (congruence). Repeats
+// until nothing merges anymore, then collects the members of every class.
+void egraph_rebuild(EGraph *g) {
+    do {
+        g->unions = 0;
+        egraph_table_reset(g, g->count);
+        for (u32 i = 0; i < g->count; i++) {
+            ENode *node = &g->nodes[i];
+            for (usize j = 0; j < node->arity; j++) {
+                node->children[j] = eclass_find(g, node->children[j]);
+            }
+
+            u32 *slot = egraph_table_slot(g, node);
+            node->duplicate = *slot != ECLASS_NONE;
+            if (node->duplicate) {
+                eclass_union(g, *slot, i);
+            } else {
+                *slot = i;
+            }
+        }
+    } while (g->unions > 0);
+
+    free(g->class_offsets);
+    free(g->class_members);
+    g->class_offsets = calloc(g->count+1, sizeof(u32));
+    g->class_members = malloc((g->count+1)*sizeof(u32));
+    assert(g->class_offsets != NULL && g->class_members != NULL);
+
+    for (u32 i = 0; i < g->count; i++) {
+        if (!g->nodes[i].duplicate) {
+            g->class_offsets[eclass_find(g, i)+1] += 1;
+        }
+    }
+    for (u32 c = 0; c < g->count; c++) {
+        g->class_offsets[c+1] += g->class_offsets[c];
+    }
+    u32 *next = malloc((g->count+1)*sizeof(u32));
+    assert(next != NULL);
+    memcpy(next, g->class_offsets, (g->count+1)*sizeof(u32));
+    for (u32 i = 0; i < g->count; i++) {
+        if (!g->nodes[i].duplicate) {
+            g->class_members[next[eclass_find(g, i)]++] = i;
+        }
+    }
+    free(next);
+}
+
+void free_egraph(EGraph *g) {
+    free(g->nodes);
+    free(g->parents);
+    free(g->has_value);
+    free(g->values);
+    free(g->table);
+    free(g->class_offsets);
+    free(g->class_members);
+}
+
+//
+// matching
+//
+
+typedef struct {
+    u32 root;
+    u32 slots[PATTERN_MAX_SLOTS];
+} EMatch;
+
+typedef struct {
+    EMatch *data;
+    usize size;
+    usize capacity;
+} EMatches;
+
+void ematches_append(EMatches *matches, EMatch match) {
+    if (matches->size == matches->capacity) {
+        matches->capacity = matches->capacity == 0 ? 64 : matches->capacity*2;
+        matches->data = realloc(matches->data, matches->capacity*sizeof(EMatch));
+        assert(matches->data != NULL);
+    }
+    matches->data[matches->size++] = match;
+}
+
+void ematch(EGraph *g, Pattern *pattern, u32 class, EMatch match, EMatches *out);
+
+// matches the children of node from index i on, every complete match is appended
+void ematch_children(EGraph *g, Pattern *pattern, ENode *node, usize i, EMatch match, EMatches *out) {
+    if (i == node->arity) {
+        ematches_append(out, match);
+        return;
+    }
+
+    Pattern *child = NULL;
+    switch (pattern->type) {
+        case PATTERN_BINOP: child = i == 0 ? pattern->binop.left : pattern->binop.right; break;
+        case PATTERN_UNARYOP: child = pattern->unaryop.operand; break;
+        case PATTERN_CALL: child = pattern->call.args[i]; break;
+        default: panic("unreachable");
+    }
+
+    EMatches partial = {0};
+    ematch(g, child, node->children[i], match, &partial);
+    for (usize j = 0; j < partial.size; j++) {
+        ematch_children(g, pattern, node, i+1, partial.data[j], out);
+    }
+    free(partial.data);
+}
+
+bool ematch_bind(EGraph *g, Pattern *pattern, u32 class, EMatch *match) {
+    if (pattern->slot == 0) {
+        return true;
+    }
+    u32 bound = match->slots[pattern->slot];
+    if (bound != ECLASS_NONE) {
+        return eclass_find(g, bound) == class;
+    }
+    match->slots[pattern->slot] = class;
+    return true;
+}
+
+// appends every way pattern matches some node of class (given the bindings in match)
+void ematch(EGraph *g, Pattern *pattern, u32 class, EMatch match, EMatches *out) {
+    class = eclass_find(g, class);
+
+    switch (pattern->type) {
+        case PATTERN_ANY:
+            if (ematch_bind(g, pattern, class, &match)) ematches_append(out, match);
+            return;
+        case PATTERN_ANY_INTEGER:
+            if (g->has_value[class] && ematch_bind(g, pattern, class, &match)) ematches_append(out, match);
+            return;
+        case PATTERN_INTEGER:
+            if (g->has_value[class] && g->values[class] == pattern->value && ematch_bind(g, pattern, class, &match)) ematches_append(out, match);
+            return;
+        default: break;
+    }
+
+    if (!ematch_bind(g, pattern, class, &match)) {
+        return;
+    }
+
+    for (u32 i = g->class_offsets[class]; i < g->class_offsets[class+1]; i++) {
+        ENode *node = &g->nodes[g->class_members[i]];
+        switch (pattern->type) {
+            case PATTERN_CONSTANT:
+                if (node->type == AST_CONSTANT && node->leaf->constant.id == pattern->constant) {
+                    ematches_append(out, match);
+                    return;
+                }
+                break;
+            case PATTERN_BINOP:
+                if (node->type == AST_BINOP && node->tag == pattern->binop.op) {
+                    ematch_children(g, pattern, node, 0, match, out);
+                }
+                break;
+            case PATTERN_UNARYOP:
+                if (node->type == AST_UNARYOP && node->tag == pattern->unaryop.op) {
+                    ematch_children(g, pattern, node, 0, match, out);
+                }
+                break;
+            case PATTERN_CALL: {
+                usize arity = 0;
+                while (arity < PATTERN_MAX_ARGS && pattern->call.args[arity] != NULL) {
+                    arity += 1;
+                }
+                if (node->type == AST_CALL && node->tag == pattern->call.function && node->arity == arity) {
+                    ematch_children(g, pattern, node, 0, match, out);
+                }
+                break;
+            }
+            default: panic("unreachable");
+        }
+    }
+}
+
+u32 egraph_instantiate(EGraph *g, Pattern *pattern, EMatch *match) {
+    if (pattern->slot != 0) {
+        assert(match->slots[pattern->slot] != ECLASS_NONE);
+        return match->slots[pattern->slot];
+    }
+
+    switch (pattern->type) {
+        case PATTERN_INTEGER: {
+            AST *leaf = init_ast_integer(g->allocator, pattern->value);
+            return egraph_add(g, (ENode){ .type = AST_INTEGER, .leaf = leaf });
+        }
+        case PATTERN_CONSTANT: {
+            AST *leaf = init_ast_constant(g->allocator, pattern->constant);
+            return egraph_add(g, (ENode){ .type = AST_CONSTANT, .leaf = leaf });
+        }
+        case PATTERN_BINOP: {
+            u32 left = egraph_instantiate(g, pattern->binop.left, match);
+            u32 right = egraph_instantiate(g, pattern->binop.right, match);
+            return egraph_add(g, (ENode){ .type = AST_BINOP, .tag = pattern->binop.op, .arity = 2, .children = { left, right } });
+        }
+        case PATTERN_UNARYOP: {
+            u32 operand = egraph_instantiate(g, pattern->unaryop.operand, match);
+            return egraph_add(g, (ENode){ .type = AST_UNARYOP, .tag = pattern->unaryop.op, .arity = 1, .children = { operand } });
+        }
+        case PATTERN_CALL: {
+            ENode call = { .type = AST_CALL, .tag = pattern->call.function };
+            for (; call.arity < PATTERN_MAX_ARGS && pattern->call.args[call.arity] != NULL; call.arity++) {
+                call.children[call.arity] = egraph_instantiate(g, pattern->call.args[call.arity], match);
+            }
+            return egraph_add(g, call);
+        }
+        case PATTERN_ANY:
+        case PATTERN_ANY_INTEGER: break;
+    }
+    panic("unbound slot in pattern");
+}
+
+//
+// extraction
+//
+
+// The cost of a tree has its number of nodes in the high 32 bits and its negative integer
+// literals in the low ones. Adding costs adds both parts, so the smaller tree always wins
+// and on a tie x-3 wins over x+-3.
+#define ECOST_NODE (1ull << 32)
+#define ECOST_INFINITE UINT64_MAX
+
+u64 leaf_cost(AST *leaf) {
+    return ECOST_NODE + (leaf->type == AST_INTEGER && leaf->integer.value < 0);
+}
+
+// Cheapest node of every class. Costs only go down, so passing over all nodes until
+// nothing changes finds the minimum.
+void egraph_costs(EGraph *g, u64 *costs, u32 *best) {
+    for (u32 i = 0; i < g->count; i++) {
+        costs[i] = ECOST_INFINITE;
+        best[i] = ECLASS_NONE;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (u32 i = 0; i < g->count; i++) {
+            ENode *node = &g->nodes[i];
+            if (node->duplicate) {
+                continue;
+            }
+
+            u64 cost = node->leaf != NULL ? leaf_cost(node->leaf) : ECOST_NODE;
+            for (usize j = 0; j < node->arity && cost != ECOST_INFINITE; j++) {
+                u64 child_cost = costs[eclass_find(g, node->children[j])];
+                cost = child_cost == ECOST_INFINITE ? ECOST_INFINITE : cost + child_cost;
+            }
+
+            u32 class = eclass_find(g, i);
+            if (cost < costs[class]) {
+                costs[class] = cost;
+                best[class] = i;
+                changed = true;
+            }
+        }
+    }
+}
+
+AST *egraph_extract(EGraph *g, u32 *best, u32 class) {
+    ENode *node = &g->nodes[best[eclass_find(g, class)]];
+    Allocator *allocator = g->allocator;
+    switch (node->type) {
+        case AST_BINOP: {
+            AST *left = egraph_extract(g, best, node->children[0]);
+            AST *right = egraph_extract(g, best, node->children[1]);
+            return init_ast_binop(allocator, left, right, node->tag);
+        }
+        case AST_UNARYOP: return init_ast_unaryop(allocator, egraph_extract(g, best, node->children[0]), node->tag);
+        case AST_CALL: {
+            ASTArray args = init_ast_array_with_capacity(allocator, node->arity);
+            for (usize i = 0; i < node->arity; i++) {
+                ast_array_append(allocator, &args, egraph_extract(g, best, node->children[i]));
+            }
+            return init_ast_call(allocator, node->tag, args);
+        }
+        default: return node->leaf;
+    }
+}
+
+// same measure as egraph_costs
+u64 ast_cost(AST *node) {
+    switch (node->type) {
+        case AST_BINOP: return ECOST_NODE + ast_cost(node->binop.left) + ast_cost(node->binop.right);
+        case AST_UNARYOP: return ECOST_NODE + ast_cost(node->unaryop.operand);
+        case AST_CALL: {
+            u64 cost = ECOST_NODE;
+            for (usize i = 0; i < node->func_call.args.size; i++) {
+                cost += ast_cost(node->func_call.args.data[i]);
+            }
+            return cost;
+        }
+        default: return leaf_cost(node);
+    }
+}
+
+AST *egraph_simplify(Interp *ip, AST *node, EGraphBudget budget, EGraphStats *stats) {
+    EGraph g = { .allocator = ip->allocator };
+    egraph_table_reset(&g, 0);
+    u32 root = egraph_add_ast(&g, node);
+    egraph_rebuild(&g);
+
+    EGraphStats result = {0};
+    EMatches matches = {0};
+    while (result.iterations < budget.max_iterations && g.count < budget.max_nodes) {
+        result.iterations += 1;
+
+        // match everything first, the classes must not change while we are matching
+        matches.size = 0;
+        usize rule_ends[EGRAPH_RULES_COUNT];
+        for (usize r = 0; r < EGRAPH_RULES_COUNT; r++) {
+            for (u32 c = 0; c < g.count && matches.size < budget.max_nodes; c++) {
+                if (g.class_offsets[c] == g.class_offsets[c+1]) {
+                    continue; // not a root
+                }
+                EMatch match = { .root = c };
+                memset(match.slots, 0xff, sizeof(match.slots));
+                ematch(&g, EGRAPH_RULES[r].left, c, match, &matches);
+            }
+            rule_ends[r] = matches.size;
+        }
+
+        usize count_before = g.count;
+        g.unions = 0;
+        usize r = 0;
+        for (usize i = 0; i < matches.size && g.count < budget.max_nodes; i++) {
+            while (rule_ends[r] <= i) {
+                r += 1;
+            }
+            u32 class = egraph_instantiate(&g, EGRAPH_RULES[r].right, &matches.data[i]);
+            eclass_union(&g, matches.data[i].root, class);
+        }
+
+        bool changed = g.count != count_before || g.unions > 0;
+        egraph_rebuild(&g);
+        if (!changed) {
+            result.saturated = true;
+            break;
+        }
+    }
+    free(matches.data);
+
+    u64 *costs = malloc(g.count*sizeof(u64));
+    u32 *best = malloc(g.count*sizeof(u32));
+    assert(costs != NULL && best != NULL);
+    egraph_costs(&g, costs, best);
+
+    // on a tie keep the input, it is already in the order interp produces
+    AST *output = node;
+    if (costs[eclass_find(&g, root)] < ast_cost(node)) {
+        output = egraph_extract(&g, best, root);
+    }
+
+    result.nodes = g.count;
+    for (u32 c = 0; c < g.count; c++) {
+        result.classes += g.class_offsets[c] != g.class_offsets[c+1];
+    }
+    if (stats != NULL) {
+        *stats = result;
+    }
+
+    free(costs);
+    free(best);
+    free_egraph(&g);
+    return output;
+}
@@ -272,6 +272,7 @@ void init_gui() {
 
             gui.last_debug_output = ast_to_debug_string(&gui.allocator, output);
 
+            free_interp(&ip);
             free_allocator(&allocator);
         }
 
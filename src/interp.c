@@ -9,101 +9,85 @@
 
 // forward declarations
 AST *interp_binop_div(Interp*, AST*, AST*);
+AST *interp_gcd(Interp*, AST*, AST*);
 AST *interp_binop(Interp*, AST*, AST*, OpType);
-
-const FunctionSignature BUILTIN_FUNCTIONS[] =  {
-    {"pow", 2}, {"exp", 1},
-    {"sqrt", 1},
-    {"sin", 1}, {"cos", 1}, {"tan", 1},
-    {"asin", 1}, {"acos", 1}, {"atan", 1},
-    {"ln", 1},
-    {"log", 2},
-    {"exp", 1},
-    {"abs", 1},
-    {"factorial", 1},
-    {"npr", 2}, {"ncr", 2},
-    {"gcd", 2}, {"lcm", 2},
-    {"diff", 1}, {"diff", 2},
-    {"ceil", 1}, {"floor", 1},
-    {"sum", 1}, {"prod", 1} // TODO: add variadic arguments here
+AST *simplify_binop(Interp*, AST*, AST*, OpType);
+
+const FunctionSignature BUILTIN_FUNCTIONS[BUILTIN_FUNCTION_COUNT] = {
+    [BUILTIN_POW] = {"pow", ARGS(2)}, [BUILTIN_EXP] = {"exp", ARGS(1)},
+    [BUILTIN_SQRT] = {"sqrt", ARGS(1)},
+    [BUILTIN_SIN] = {"sin", ARGS(1)}, [BUILTIN_COS] = {"cos", ARGS(1)}, [BUILTIN_TAN] = {"tan", ARGS(1)},
+    [BUILTIN_ASIN] = {"asin", ARGS(1)}, [BUILTIN_ACOS] = {"acos", ARGS(1)}, [BUILTIN_ATAN] = {"atan", ARGS(1)},
+    [BUILTIN_LN] = {"ln", ARGS(1)},
+    [BUILTIN_LOG] = {"log", ARGS(2)},
+    [BUILTIN_ABS] = {"abs", ARGS(1)},
+    [BUILTIN_FACTORIAL] = {"factorial", ARGS(1)},
+    [BUILTIN_NPR] = {"npr", ARGS(2)}, [BUILTIN_NCR] = {"ncr", ARGS(2)},
+    [BUILTIN_GCD] = {"gcd", ARGS(2)}, [BUILTIN_LCM] = {"lcm", ARGS(2)},
+    [BUILTIN_FACTOR] = {"factor", ARGS(1)}, [BUILTIN_ISPRIME] = {"isprime", ARGS(1)}, [BUILTIN_NEXTPRIME] = {"nextprime", ARGS(1)},
+    [BUILTIN_DIFF] = {"diff", ARGS(1) | ARGS(2)},
+    [BUILTIN_CEIL] = {"ceil", ARGS(1)}, [BUILTIN_FLOOR] = {"floor", ARGS(1)},
+    [BUILTIN_SUM] = {"sum", ARGS(1)}, [BUILTIN_PROD] = {"prod", ARGS(1)}, // TODO: add variadic arguments here
+    [BUILTIN_SIMPLIFY] = {"simplify", ARGS(1)},
 };
-const usize BUILTIN_FUNCTIONS_COUNT = sizeof(BUILTIN_FUNCTIONS) / sizeof(FunctionSignature);
 
-const char *BUILTIN_CONSTANTS[] = {
-    "pi", "e"
+const char *BUILTIN_CONSTANTS[BUILTIN_CONSTANT_COUNT] = {
+    [CONSTANT_PI] = "pi", [CONSTANT_E] = "e"
 };
-const usize BUILTIN_CONSTANTS_COUNT = sizeof(BUILTIN_CONSTANTS) / sizeof(BUILTIN_CONSTANTS[0]);
 
-bool is_builtin_function(String s) {
-    for (usize i = 0; i < BUILTIN_FUNCTIONS_COUNT; i++) {
-        if (!strcmp(s.str, BUILTIN_FUNCTIONS[i].name)) {
-            return true;
-        }
-    }
-
-    return false;
+bool check_builtin_function_signature(BuiltinFunction function, ASTArray args) {
+    assert(function != BUILTIN_NONE);
+    return args.size < 32 && (BUILTIN_FUNCTIONS[function].args_counts & ARGS(args.size));
 }
 
-bool check_builtin_function_signature(String name, ASTArray args) {
-    for (usize i = 0; i < BUILTIN_FUNCTIONS_COUNT; i++) {
-        FunctionSignature signature = BUILTIN_FUNCTIONS[i];
-        if (string_eq(init_string(signature.name), name) && signature.args_count == args.size) {
-            // we found a signature that fits to the given one
-            return true;
-        } 
-    }
-
-    return false;
+const char *builtin_function_to_string(BuiltinFunction function) {
+    assert(function != BUILTIN_NONE && function < BUILTIN_FUNCTION_COUNT);
+    return BUILTIN_FUNCTIONS[function].name;
 }
 
-bool is_builtin_constant(String s) {
-    for (usize i = 0; i < BUILTIN_CONSTANTS_COUNT; i++) {
-        if (!strcmp(s.str, BUILTIN_CONSTANTS[i])) return true;
-    }  
-    return false;
+const char *builtin_constant_to_string(BuiltinConstant constant) {
+    assert(constant != CONSTANT_NONE && constant < BUILTIN_CONSTANT_COUNT);
+    return BUILTIN_CONSTANTS[constant];
 }
 
 //
 // math
 //
 
-i64 factorial(i64 n) {
-    i64 result = 1;
-    for (i64 m = 1; m <= n; m++) {
-        result *= m;
+bool ast_match(AST* left, AST* right) {
+    // with hash-consing equal trees of the same allocator are the same node,
+    // in any case different hashes mean different trees
+    if (left == right) {
+        return true;
     }
-    return result;
-}
-
-i64 gcd(i64 a, i64 b) {
-    // Euclidean algorithm - https://en.wikipedia.org/wiki/Euclidean_algorithm
-    
-    while (b != 0) {
-        i64 t = b;
-        b = a % b;
-        a = t;
+    if (left->hash != right->hash) {
+        return false;
     }
 
-    return a;
-}
-
-bool ast_match(AST* left, AST* right) {
-
     if (left->type == right->type) {
         switch (left->type) {
             case AST_INTEGER:
                 return left->integer.value == right->integer.value;
+            case AST_BIGINT:
+                return bignum_compare(left->bigint.value, right->bigint.value) == 0;
+            case AST_RATIONAL:
+                return ast_match(left->rational.numerator, right->rational.numerator) && ast_match(left->rational.denominator, right->rational.denominator);
+            case AST_FACTORED:
+                return ast_match(left->factored.product, right->factored.product);
             case AST_REAL:
                 return left->real.value == right->real.value;
             case AST_SYMBOL:
-                return string_eq(left->symbol.name, right->symbol.name);
+                // interned, so the same name is always the same pointer
+                return left->symbol.name.str == right->symbol.name.str;
             case AST_CONSTANT:
-                return string_eq(left->constant.name, right->constant.name);
+                return left->constant.id == right->constant.id;
             case AST_BINOP:
-                return ast_match(left->binop.left, right->binop.left) && ast_match(left->binop.right, right->binop.right);
+                return left->binop.op == right->binop.op && ast_match(left->binop.left, right->binop.left) && ast_match(left->binop.right, right->binop.right);
+            case AST_UNARYOP:
+                return left->unaryop.op == right->unaryop.op && ast_match(left->unaryop.operand, right->unaryop.operand);
             case AST_CALL: {
                 if (
-                    string_eq(left->func_call.name, right->func_call.name) &&
+                    left->func_call.function == right->func_call.function &&
                     left->func_call.args.size == right->func_call.args.size
                 ) {
                     for (usize i = 0; i < left->func_call.args.size; i++) {
@@ -115,6 +99,19 @@ bool ast_match(AST* left, AST* right) {
                 }
                 return false;
             }
+            case AST_LIST: {
+                if (left->list.nodes.size != right->list.nodes.size) {
+                    return false;
+                }
+                for (usize i = 0; i < left->list.nodes.size; i++) {
+                    if (!ast_match(left->list.nodes.data[i], right->list.nodes.data[i])) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            case AST_EMPTY:
+                return true;
             default: fprintf(stderr, "ERROR: Cannot do 'ast_match' because node type '%s' is not implemented.\n", ast_type_to_debug_string(left->type)); exit(1);
         }
     }
@@ -122,6 +119,111 @@ bool ast_match(AST* left, AST* right) {
     return false;
 }
 
+i32 ast_compare(AST *left, AST *right) {
+    // Total order used to sort the operands of sums and products, equal trees compare
+    // as 0. Symbols are ordered by name so the output doesn't depend on addresses.
+    if (left == right) {
+        return 0;
+    }
+
+    // powers of the same base sort next to each other in descending degree, x^3 x^2 x
+    bool left_is_pow = left->type == AST_BINOP && left->binop.op == OP_POW;
+    bool right_is_pow = right->type == AST_BINOP && right->binop.op == OP_POW;
+    if (left_is_pow || right_is_pow) {
+        i32 result = ast_compare(left_is_pow ? left->binop.left : left, right_is_pow ? right->binop.left : right);
+        if (result != 0) {
+            return result;
+        }
+
+        AST *left_exponent = left_is_pow ? left->binop.right : &ast_one;
+        AST *right_exponent = right_is_pow ? right->binop.right : &ast_one;
+        if (ast_is_numeric(left_exponent) && ast_is_numeric(right_exponent)) {
+            f64 l = ast_to_f64(left_exponent);
+            f64 r = ast_to_f64(right_exponent);
+            if (l != r) {
+                return l > r ? -1 : 1;
+            }
+        }
+        result = ast_compare(right_exponent, left_exponent);
+        if (result != 0) {
+            return result;
+        }
+        return (i32)right_is_pow - (i32)left_is_pow;
+    }
+
+    if (left->type != right->type) {
+        return left->type < right->type ? -1 : 1;
+    }
+
+    switch (left->type) {
+        case AST_INTEGER: {
+            i64 l = left->integer.value;
+            i64 r = right->integer.value;
+            return l < r ? -1 : l > r;
+        }
+        case AST_BIGINT:
+            return bignum_compare(left->bigint.value, right->bigint.value);
+        case AST_RATIONAL: {
+            i32 result = ast_compare(left->rational.numerator, right->rational.numerator);
+            if (result != 0) {
+                return result;
+            }
+            return ast_compare(left->rational.denominator, right->rational.denominator);
+        }
+        case AST_FACTORED:
+            return ast_compare(left->factored.product, right->factored.product);
+        case AST_REAL: {
+            f64 l = left->real.value;
+            f64 r = right->real.value;
+            return l < r ? -1 : l > r;
+        }
+        case AST_SYMBOL: {
+            String l = left->symbol.name;
+            String r = right->symbol.name;
+            i32 result = memcmp(l.str, r.str, l.size < r.size ? l.size : r.size);
+            if (result != 0) {
+                return result;
+            }
+            return l.size < r.size ? -1 : l.size > r.size;
+        }
+        case AST_CONSTANT:
+            return left->constant.id < right->constant.id ? -1 : left->constant.id > right->constant.id;
+        case AST_BINOP: {
+            if (left->binop.op != right->binop.op) {
+                return left->binop.op < right->binop.op ? -1 : 1;
+            }
+            i32 result = ast_compare(left->binop.left, right->binop.left);
+            if (result != 0) {
+                return result;
+            }
+            return ast_compare(left->binop.right, right->binop.right);
+        }
+        case AST_UNARYOP: {
+            if (left->unaryop.op != right->unaryop.op) {
+                return left->unaryop.op < right->unaryop.op ? -1 : 1;
+            }
+            return ast_compare(left->unaryop.operand, right->unaryop.operand);
+        }
+        case AST_CALL:
+        case AST_LIST: {
+            if (left->type == AST_CALL && left->func_call.function != right->func_call.function) {
+                return left->func_call.function < right->func_call.function ? -1 : 1;
+            }
+            ASTArray l = left->type == AST_CALL ? left->func_call.args : left->list.nodes;
+            ASTArray r = right->type == AST_CALL ? right->func_call.args : right->list.nodes;
+            for (usize i = 0; i < l.size && i < r.size; i++) {
+                i32 result = ast_compare(l.data[i], r.data[i]);
+                if (result != 0) {
+                    return result;
+                }
+            }
+            return l.size < r.size ? -1 : l.size > r.size;
+        }
+        case AST_EMPTY: return 0;
+        default: fprintf(stderr, "ERROR: Cannot do 'ast_compare' because node type '%s' is not implemented.\n", ast_type_to_debug_string(left->type)); exit(1);
+    }
+}
+
 bool ast_match_type(AST *left, AST *right) {
     if (left->type != right->type) {
         return false;
@@ -129,6 +231,9 @@ bool ast_match_type(AST *left, AST *right) {
 
     switch (left->type) {
         case AST_INTEGER: return true;
+        case AST_BIGINT: return true;
+        case AST_RATIONAL: return true;
+        case AST_FACTORED: return true;
         case AST_BINOP: {
             if (left->binop.op == right->binop.op) {
                 AST *ll = left->binop.left;;
@@ -150,184 +255,407 @@ bool ast_match_type(AST *left, AST *right) {
 }
 
 String ast_to_debug_string(Allocator *allocator, AST* node) {
-    String output = {0};
-    output.str = alloc(allocator, 1024);
     switch (node->type) {
 
         case AST_INTEGER:
-            sprintf(output.str, "%s(%lld)", ast_type_to_debug_string(node->type), node->integer.value);
-            break;
+            return string_format(allocator, "%s(%lld)", ast_type_to_debug_string(node->type), node->integer.value);
+
+        case AST_BIGINT: {
+            String digits = bignum_to_string(allocator, node->bigint.value);
+            return string_format(allocator, "%s(%.*s)", ast_type_to_debug_string(node->type), (int)digits.size, digits.str);
+        }
+
+        case AST_RATIONAL: {
+            String numerator_string = ast_to_debug_string(allocator, node->rational.numerator);
+            String denominator_string = ast_to_debug_string(allocator, node->rational.denominator);
+            return string_format(allocator, "%s(%.*s, %.*s)", ast_type_to_debug_string(node->type), (int)numerator_string.size, numerator_string.str, (int)denominator_string.size, denominator_string.str);
+        }
+
+        case AST_FACTORED: {
+            String product_string = ast_to_debug_string(allocator, node->factored.product);
+            return string_format(allocator, "%s(%.*s)", ast_type_to_debug_string(node->type), (int)product_string.size, product_string.str);
+        }
         
         case AST_REAL:
-            sprintf(output.str, "%s(%f)", ast_type_to_debug_string(node->type), node->real.value);
-            break;
+            return string_format(allocator, "%s(%f)", ast_type_to_debug_string(node->type), node->real.value);
         
         case AST_SYMBOL:
-            sprintf(output.str, "%s(%s)", ast_type_to_debug_string(node->type), node->symbol.name.str);
-            break;
+            return string_format(allocator, "%s(%.*s)", ast_type_to_debug_string(node->type), (int)node->symbol.name.size, node->symbol.name.str);
         
         case AST_BINOP: {
             const char *op_string = op_type_to_debug_string(node->binop.op);
             String left_string = ast_to_debug_string(allocator, node->binop.left);
             String right_string = ast_to_debug_string(allocator, node->binop.right);
-            sprintf(output.str, "%s(%s, %s)", op_string, left_string.str, right_string.str);
-            break;
+            return string_format(allocator, "%s(%.*s, %.*s)", op_string, (int)left_string.size, left_string.str, (int)right_string.size, right_string.str);
         }
         
-        case AST_UNARYOP: sprintf(output.str, "%s(%s)", op_type_to_debug_string(node->unaryop.op), ast_to_debug_string(allocator, node->unaryop.operand).str); break;
+        case AST_UNARYOP: {
+            String operand_string = ast_to_debug_string(allocator, node->unaryop.operand);
+            return string_format(allocator, "%s(%.*s)", op_type_to_debug_string(node->unaryop.op), (int)operand_string.size, operand_string.str);
+        }
         
         // TODO: args to debug string
         case AST_CALL: {
             if (node->func_call.args.size == 1) {
-                sprintf(output.str, "FuncCall(%s, %s)", node->func_call.name.str, ast_to_debug_string(allocator, node->func_call.args.data[0]).str); break;
+                String arg_string = ast_to_debug_string(allocator, node->func_call.args.data[0]);
+                return string_format(allocator, "FuncCall(%s, %.*s)", builtin_function_to_string(node->func_call.function), (int)arg_string.size, arg_string.str);
             } else {
                 // multiple args to string @todo
-                sprintf(output.str, "FuncCall(%s, args)", node->func_call.name.str); break;
+                return string_format(allocator, "FuncCall(%s, args)", builtin_function_to_string(node->func_call.function));
             }
         }
 
-        case AST_EMPTY: sprintf(output.str, "Empty()"); break;
+        case AST_EMPTY: return string_format(allocator, "Empty()");
 
-        case AST_PROGRAM: todo();
+        case AST_PROGRAM: return string_format(allocator, "Program(...)");
 
-        case AST_CONSTANT: todo();
+        case AST_CONSTANT: return string_format(allocator, "%s(%s)", ast_type_to_debug_string(node->type), builtin_constant_to_string(node->constant.id));
 
         case AST_ASSIGN: todo();
 
-        case AST_LIST: sprintf(output.str, "List(...)"); break;
+        case AST_LIST: return string_format(allocator, "List(...)");
 
         case AST_TYPE_COUNT: todo();  
     
     }
-    return output;
+    return (String){0};
 }
 
-String _ast_to_string(Allocator *allocator, AST* node, u8 op_precedence) {
-    // TODO: The use of String in here is very hacky and should be changed in the future.
-    //       One of the problems here is that directly writing and accessing the memory
-    //       in output.str doesn't affect the size. So without the hacks, the size of the
-    //       result string will be 0 in the end.
-
-    String output = {0};
-    output.str = alloc(allocator, 1024);
+void ast_to_string_append(Allocator *allocator, AST *node, u8 op_precedence, String *s, usize *capacity) {
+    // everything is written into one growing buffer, so long chains print in linear time
     switch (node->type) {
 
-        case AST_INTEGER: sprintf(output.str, "%lld", node->integer.value); break;
-        
-        case AST_REAL: sprintf(output.str, "%f", node->real.value); break;
-        
-        case AST_SYMBOL:
-            sprintf(output.str, "%s", node->symbol.name.str); break;
+        case AST_INTEGER: string_append_format(allocator, s, capacity, "%lld", node->integer.value); break;
 
-        case AST_CONSTANT:
-            sprintf(output.str, "%s", node->constant.name.str); break;
-        
-        case AST_BINOP: {
+        case AST_BIGINT: {
+            // not in allocator, the output buffer has to stay its last allocation
+            Allocator tmp = init_allocator();
+            String digits = bignum_to_string(&tmp, node->bigint.value);
+            string_append_format(allocator, s, capacity, "%.*s", (int)digits.size, digits.str);
+            free_allocator(&tmp);
+            break;
+        }
 
-            uint8_t current_op_precedence = op_type_precedence(node->binop.op);
+        case AST_RATIONAL: {
+            // printed like the division it replaces
+            u8 current_op_precedence = op_type_precedence(OP_DIV);
+            bool parens = current_op_precedence < op_precedence;
 
-            String left_string = _ast_to_string(allocator, node->binop.left, current_op_precedence);
-            String right_string = _ast_to_string(allocator, node->binop.right, current_op_precedence);
-            const char *op_type_string = op_type_to_string(node->binop.op);
+            if (parens) string_append_format(allocator, s, capacity, "(");
+            ast_to_string_append(allocator, node->rational.numerator, current_op_precedence, s, capacity);
+            string_append_format(allocator, s, capacity, "/");
+            ast_to_string_append(allocator, node->rational.denominator, current_op_precedence, s, capacity);
+            if (parens) string_append_format(allocator, s, capacity, ")");
+            break;
+        }
 
-            if (current_op_precedence < op_precedence) {
-                sprintf(output.str, "(%s%s%s)", left_string.str, op_type_string, right_string.str);
-            } else {
-                sprintf(output.str, "%s%s%s", left_string.str, op_type_string, right_string.str);
+        // the product gets parens wherever the multiplication it is would need them
+        case AST_FACTORED: ast_to_string_append(allocator, node->factored.product, op_precedence, s, capacity); break;
+
+        case AST_REAL: string_append_format(allocator, s, capacity, "%f", node->real.value); break;
+
+        case AST_SYMBOL:
+            string_append_format(allocator, s, capacity, "%.*s", (int)node->symbol.name.size, node->symbol.name.str);
+            break;
+
+        case AST_CONSTANT:
+            string_append_format(allocator, s, capacity, "%s", builtin_constant_to_string(node->constant.id));
+            break;
+
+        case AST_BINOP: {
+            // walk down the left spine without recursion, sums are left-deep and can be long
+            usize count = 0;
+            for (AST *n = node; n->type == AST_BINOP; n = n->binop.left) {
+                count += 1;
+            }
+            assert(count > 0); // node itself is a binop
+            AST **spine = malloc(count*sizeof(AST*));
+            assert(spine != NULL);
+            AST *n = node;
+            for (usize i = 0; i < count; i++) {
+                spine[i] = n;
+                n = n->binop.left;
             }
 
+            // every node of the spine is printed with the precedence of the one above
+            for (usize i = 0; i < count; i++) {
+                u8 outer_precedence = i == 0 ? op_precedence : op_type_precedence(spine[i-1]->binop.op);
+                if (op_type_precedence(spine[i]->binop.op) < outer_precedence) {
+                    string_append_format(allocator, s, capacity, "(");
+                }
+            }
+            ast_to_string_append(allocator, n, op_type_precedence(spine[count-1]->binop.op), s, capacity);
+            for (usize i = count; i > 0; i--) {
+                AST *binop = spine[i-1];
+                u8 current_op_precedence = op_type_precedence(binop->binop.op);
+                u8 outer_precedence = i == 1 ? op_precedence : op_type_precedence(spine[i-2]->binop.op);
+                string_append_format(allocator, s, capacity, "%s", op_type_to_string(binop->binop.op));
+                ast_to_string_append(allocator, binop->binop.right, current_op_precedence, s, capacity);
+                if (current_op_precedence < outer_precedence) {
+                    string_append_format(allocator, s, capacity, ")");
+                }
+            }
+            free(spine);
             break;
         }
 
         case AST_UNARYOP: {
-            uint8_t current_op_precedence = op_type_precedence(node->binop.op);
+            bool parens = op_type_precedence(node->unaryop.op) < op_precedence;
 
-            String expr_string = _ast_to_string(allocator, node->unaryop.operand, op_precedence);
-            const char *op_type_string = op_type_to_string(node->unaryop.op);
-
-            if (current_op_precedence < op_precedence) {
-                sprintf(output.str, "(%s%s)", op_type_string, expr_string.str); break;
-            } else {
-                sprintf(output.str, "%s%s", op_type_string, expr_string.str); break;
-            }
-            
+            if (parens) string_append_format(allocator, s, capacity, "(");
+            string_append_format(allocator, s, capacity, "%s", op_type_to_string(node->unaryop.op));
+            ast_to_string_append(allocator, node->unaryop.operand, op_precedence, s, capacity);
+            if (parens) string_append_format(allocator, s, capacity, ")");
+            break;
         }
 
         case AST_CALL: {
+            string_append_format(allocator, s, capacity, "%s(", builtin_function_to_string(node->func_call.function));
             if (node->func_call.args.size == 1) {
-                String arg_string = _ast_to_string(allocator, node->func_call.args.data[0], op_precedence);
-                sprintf(output.str, "%s(%s)", node->func_call.name.str, arg_string.str); break;
+                ast_to_string_append(allocator, node->func_call.args.data[0], op_precedence, s, capacity);
             } else {
                 // multiple args to string @todo
-                sprintf(output.str, "%s(args)", node->func_call.name.str); break;
+                string_append_format(allocator, s, capacity, "args");
             }
+            string_append_format(allocator, s, capacity, ")");
+            break;
         }
 
-        case AST_LIST: {
-            sprintf(output.str, "[elements]"); break;
-        }
+        case AST_LIST: string_append_format(allocator, s, capacity, "[elements]"); break;
 
         case AST_EMPTY: break;
-        
+
         default: fprintf(stderr, "ERROR: Cannot do 'ast_to_string' because node type '%s' is not implemented.\n", ast_type_to_debug_string(node->type)); exit(1);
-    
+
     }
+}
 
-    // TODO: remove this when String has the functionality to remove the hacks in this function
-    // 
-    // determine the size of the string
-    for (usize i = 0; i < 1024; i++) {
-        if (output.str[i] == '\0') {
-            output.size = i;
-            break;
+String _ast_to_string(Allocator *allocator, AST* node, u8 op_precedence) {
+    String s = {0};
+    usize capacity = 0;
+    ast_to_string_append(allocator, node, op_precedence, &s, &capacity);
+    if (s.str == NULL) {
+        return string_format(allocator, "");
+    }
+    return s;
+}
+
+AST *interp_real(Interp *ip, f64 value) {
+    // same as interp(ip, REAL(value)), but whole numbers never allocate a temporary real
+    if (value - floor(value) == 0.0) {
+        // 2^63 is the first double which doesn't fit
+        if (fabs(value) < 9223372036854775808.0) {
+            return INTEGER((i64)value);
+        }
+        return BIGINT(bignum_from_f64(ip->allocator, value));
+    }
+    return REAL(value);
+}
+
+AST *interp_u64(Interp *ip, u64 value) {
+    return value <= INT64_MAX ? INTEGER((i64)value) : BIGINT(bignum_from_u64(ip->allocator, value));
+}
+
+// Integer arithmetic is exact. Two i64 operands take the fast path with overflow
+// checks, whatever doesn't fit is redone with bignums.
+bool i64_pow(i64 base, i64 exponent, i64 *result) {
+    // square and multiply, false on overflow
+    assert(exponent >= 0);
+    i64 value = 1;
+    while (exponent > 0) {
+        if ((exponent & 1) && __builtin_mul_overflow(value, base, &value)) {
+            return false;
+        }
+        exponent >>= 1;
+        // the result contains this square, so if it overflows the result does too
+        if (exponent > 0 && __builtin_mul_overflow(base, base, &base)) {
+            return false;
+        }
+    }
+    *result = value;
+    return true;
+}
+
+AST *interp_bigint_binop(Interp *ip, AST *left, AST *right, OpType op) {
+    Allocator *allocator = ip->allocator;
+    Bignum a = ast_to_bignum(allocator, left);
+    Bignum b = ast_to_bignum(allocator, right);
+
+    switch (op) {
+        case OP_ADD: return BIGINT(bignum_add(allocator, a, b));
+        case OP_SUB: return BIGINT(bignum_sub(allocator, a, b));
+        case OP_MUL: return BIGINT(bignum_mul(allocator, a, b));
+        case OP_DIV: {
+            Bignum quotient, remainder;
+            bignum_divmod(allocator, a, b, &quotient, &remainder);
+            return remainder.size == 0 ? BIGINT(quotient) : interp_rational(ip, left, right);
+        }
+        case OP_MOD: {
+            Bignum remainder;
+            bignum_divmod(allocator, a, b, NULL, &remainder);
+            return BIGINT(remainder);
+        }
+        case OP_POW: {
+            // the exponent can be huge for 0, 1 and -1, everything else has to stay
+            // below BIGNUM_MAX_POW_BITS
+            if (a.size == 0) {
+                return b.negative ? POW(left, right) : &ast_zero;
+            } else if (a.size == 1 && a.limbs[0] == 1) {
+                return a.negative && (b.limbs[0] & 1) ? &ast_minus_one : &ast_one;
+            }
+            i64 exponent;
+            if (!bignum_to_i64(b, &exponent) || (exponent < 0 ? -(u64)exponent : (u64)exponent) > BIGNUM_MAX_POW_BITS/(32*a.size)) {
+                return POW(left, right);
+            }
+            if (exponent < 0) {
+                return interp_binop_div(ip, &ast_one, BIGINT(bignum_pow(allocator, a, -(u64)exponent)));
+            }
+            return BIGINT(bignum_pow(allocator, a, exponent));
+        }
+        default: assert(false);
+    }
+}
+
+AST *interp_integer_binop(Interp *ip, AST *left, AST *right, OpType op) {
+    if (left->type == AST_INTEGER && right->type == AST_INTEGER) {
+        i64 a = left->integer.value;
+        i64 b = right->integer.value;
+        i64 result;
+
+        switch (op) {
+            case OP_ADD: if (!__builtin_add_overflow(a, b, &result)) return INTEGER(result); break;
+            case OP_SUB: if (!__builtin_sub_overflow(a, b, &result)) return INTEGER(result); break;
+            case OP_MUL: if (!__builtin_mul_overflow(a, b, &result)) return INTEGER(result); break;
+            case OP_DIV: {
+                assert(b != 0); // zero division
+                // INT64_MIN / -1 is the only quotient which doesn't fit
+                if (a == INT64_MIN && b == -1) break;
+                return a % b == 0 ? INTEGER(a / b) : interp_rational(ip, left, right);
+            }
+            case OP_MOD: {
+                assert(b != 0); // see interp_binop_mod
+                return INTEGER(b == -1 ? 0 : a % b);
+            }
+            case OP_POW: if (b >= 0 && i64_pow(a, b, &result)) return INTEGER(result); break;
+            default: assert(false);
+        }
+    }
+
+    return interp_bigint_binop(ip, left, right, op);
+}
+
+// Patterns of the hand-written simplification rules below, the ones which only
+// replace one shape by another are in the rule table of rewrite.c. They are static,
+// so checking a rule doesn't allocate anything.
+static Pattern *ZERO_PATTERN = MATCH_INTEGER(0);
+static Pattern *ONE_PATTERN = MATCH_INTEGER(1);
+static Pattern *MINUS_ONE_PATTERN = MATCH_INTEGER(-1);
+static Pattern *MUL_PATTERN = MATCH_BINOP(OP_MUL, MATCH_ANY(1), MATCH_ANY(2));
+static Pattern *POW_PATTERN = MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_ANY(2));
+
+// Rationals are always reduced with a positive denominator, so equal numbers are equal
+// nodes, and a denominator of 1 gives an integer.
+AST *interp_rational(Interp *ip, AST *numerator, AST *denominator) {
+    if (numerator->type == AST_INTEGER && denominator->type == AST_INTEGER) {
+        i64 n = numerator->integer.value;
+        i64 d = denominator->integer.value;
+        assert(d != 0); // zero division
+
+        // everything in machine words, unless INT64_MIN makes the gcd or a sign flip overflow
+        u64 divisor = u64_gcd(n < 0 ? -(u64)n : (u64)n, d < 0 ? -(u64)d : (u64)d);
+        if (divisor <= INT64_MAX) {
+            n /= (i64)divisor;
+            d /= (i64)divisor;
+            if (d < 0 && n != INT64_MIN && d != INT64_MIN) {
+                n = -n;
+                d = -d;
+            }
+            if (d > 0) {
+                return d == 1 ? INTEGER(n) : RATIONAL(INTEGER(n), INTEGER(d));
+            }
         }
     }
 
-    return output;
+    AST *divisor = interp_gcd(ip, numerator, denominator);
+    if (ast_to_f64(denominator) < 0) {
+        divisor = interp_integer_binop(ip, &ast_zero, divisor, OP_SUB);
+    }
+    numerator = interp_integer_binop(ip, numerator, divisor, OP_DIV);
+    denominator = interp_integer_binop(ip, denominator, divisor, OP_DIV);
+    return pattern_match(ONE_PATTERN, denominator, NULL) ? numerator : RATIONAL(numerator, denominator);
+}
+
+void rational_parts(AST *node, AST **numerator, AST **denominator) {
+    if (node->type == AST_RATIONAL) {
+        *numerator = node->rational.numerator;
+        *denominator = node->rational.denominator;
+    } else {
+        assert(ast_is_integer(node));
+        *numerator = node;
+        *denominator = &ast_one;
+    }
+}
+
+// exact arithmetic on integers and rationals, one reduction at the end
+AST *interp_rational_binop(Interp *ip, AST *left, AST *right, OpType op) {
+    if (ast_is_integer(left) && ast_is_integer(right)) {
+        return interp_integer_binop(ip, left, right, op);
+    }
+
+    AST *a, *b, *c, *d;
+    rational_parts(left, &a, &b);
+    rational_parts(right, &c, &d);
+
+    switch (op) {
+        case OP_ADD:
+        case OP_SUB: {
+            // a/b +- c/d = (ad +- cb)/bd
+            AST *numerator = interp_integer_binop(ip, interp_integer_binop(ip, a, d, OP_MUL), interp_integer_binop(ip, c, b, OP_MUL), op);
+            return interp_rational(ip, numerator, interp_integer_binop(ip, b, d, OP_MUL));
+        }
+        case OP_MUL: return interp_rational(ip, interp_integer_binop(ip, a, c, OP_MUL), interp_integer_binop(ip, b, d, OP_MUL));
+        case OP_DIV: return interp_rational(ip, interp_integer_binop(ip, a, d, OP_MUL), interp_integer_binop(ip, b, c, OP_MUL));
+        case OP_POW: {
+            // (a/b)^n = a^n/b^n is already reduced, (a/b)^-n = b^n/a^n
+            assert(ast_is_integer(right));
+            bool negative = ast_to_f64(right) < 0;
+            AST *exponent = negative ? interp_integer_binop(ip, &ast_zero, right, OP_SUB) : right;
+            AST *numerator = interp_integer_binop(ip, a, exponent, OP_POW);
+            AST *denominator = interp_integer_binop(ip, b, exponent, OP_POW);
+            if (!ast_is_integer(numerator) || !ast_is_integer(denominator)) {
+                // too big, see BIGNUM_MAX_POW_BITS
+                return POW(left, right);
+            }
+            return negative ? interp_rational(ip, denominator, numerator) : interp_rational(ip, numerator, denominator);
+        }
+        default: assert(false);
+    }
 }
 
 AST* interp_binop_add(Interp *ip, AST *left, AST *right) {
+    if (ast_is_rational(left) && ast_is_rational(right)) {
+        return interp_rational_binop(ip, left, right, OP_ADD);
+    }
+
     // basic rules
-    if (ast_match(left, INTEGER(0))) {
+    if (pattern_match(ZERO_PATTERN, left, NULL)) {
         return right;
-    } else if (ast_match(right, INTEGER(0))) {
+    } else if (pattern_match(ZERO_PATTERN, right, NULL)) {
         return left;
     } else if (ast_match(left, right)) {
-        return interp(ip, MUL(INTEGER(2), left));
-    }
-    
-    // fractions
-    if (ast_is_fraction(left) && ast_is_fraction(right)) {
-        // a/b + c/d
-        i64 a = left->binop.left->integer.value;
-        i64 b = left->binop.right->integer.value;
-        i64 c = right->binop.left->integer.value;
-        i64 d = right->binop.right->integer.value;
-        return interp_binop_div(ip, INTEGER(a*d+c*b), INTEGER(b*d));
-    } else if (left->type == AST_INTEGER && ast_is_fraction(right)) {
-        // c + a/b
-        // -> (cb)/b + a/b
-        // -> (cb+a)/b
-        AST *c = left;
-        AST *a = right->binop.left;
-        AST *b = right->binop.right;
-        // we need depth again so interp instead of interp_binop_add
-        return interp(ip, DIV(ADD(MUL(c, b), a), b));
-    } else if (ast_is_fraction(left) && right->type == AST_INTEGER) {
-        return interp_binop_add(ip, right, left);
+        return interp(ip, MUL(&ast_two, left));
     }
     
-    // TODO: remember which rule this is and simplify it
-    if (left->type == AST_BINOP && left->binop.op == OP_MUL) {
-        if (ast_match(left->binop.right, right)) {
-            AST *new_left = interp_binop_add(ip, INTEGER(1), left->binop.left);
-            return MUL(new_left, right);
-        }
+    // a*x + x -> (a+1)*x
+    AST *bindings[PATTERN_MAX_SLOTS] = {0};
+    if (pattern_match(MUL_PATTERN, left, bindings) && ast_match(bindings[2], right)) {
+        AST *new_left = interp_binop_add(ip, &ast_one, bindings[1]);
+        return MUL(new_left, right);
     }
     
     // compute numeric
     if (ast_is_numeric(left) && ast_is_numeric(right)) {
-        return interp(ip, REAL(ast_to_f64(left)+ast_to_f64(right)));
+        return interp_real(ip, ast_to_f64(left)+ast_to_f64(right));
     }
 
     // +- with numbers
@@ -336,37 +664,15 @@ AST* interp_binop_add(Interp *ip, AST *left, AST *right) {
         if (value < 0.0) {
             switch (right->type) {
                 
-                case AST_INTEGER: {
-                    i64 new_value = labs(right->integer.value);
-                    return SUB(left, INTEGER(new_value));
-                }
+                case AST_INTEGER:
+                case AST_BIGINT:
+                case AST_RATIONAL: return SUB(left, interp_rational_binop(ip, &ast_zero, right, OP_SUB));
 
                 case AST_REAL: {
                     f64 new_value = -1.0 * right->real.value;
                     return SUB(left, REAL(new_value));
                 }
 
-                case AST_BINOP: {
-                    if (ast_is_fraction(right)) {
-                        AST *a = right->binop.left;
-                        AST *b = right->binop.right;
-                        
-                        assert(a->type == AST_INTEGER);
-                        assert(b->type == AST_INTEGER);
-
-                        if (a->integer.value < 0.0) {
-                            i64 new_a_value = labs(a->integer.value);
-                            return SUB(left, DIV(INTEGER(new_a_value), b));
-                        } else if (b->integer.value < 0.0) {
-                            i64 new_b_value = labs(b->integer.value);
-                            return SUB(left, DIV(a, INTEGER(new_b_value)));
-                        } else {
-                            panic("unreachable")
-                        }
-
-                    }
-                }
-
                 default: todo();
 
             }
@@ -385,131 +691,339 @@ AST* interp_binop_add(Interp *ip, AST *left, AST *right) {
 }
 
 AST* interp_binop_sub(Interp *ip, AST *left, AST *right) {
-    
-    if (ast_match_type(left, INTEGER(1)) && ast_match_type(right, DIV(INTEGER(1), INTEGER(1)))) {
-        //   a - b/c
-        // = ac/c - b/c
-        // = (ac-b)/c
-        AST* a = left;
-        AST* b = right->binop.left;
-        AST* c = right->binop.right;
-        return interp(ip, DIV(SUB(MUL(a, c), b), c));
-    } else if (ast_is_fraction(left) && right->type == AST_INTEGER) {
-        //   a/b - c 
-        // = a/b - cb/b
-        // = (a-cb)/b
-        AST *a = left->binop.left;
-        AST *b = left->binop.right;
-        AST *c = right;
-        // we need depth again
-        return interp(ip, DIV(SUB(a, MUL(c, b)), b));
-    } else if (left->type == AST_INTEGER && ast_is_fraction(right)) {
-        return interp_binop_sub(ip, right, left);
-    } else if (ast_match(right, INTEGER(0))) {
+    if (ast_is_rational(left) && ast_is_rational(right)) {
+        return interp_rational_binop(ip, left, right, OP_SUB);
+    }
+
+    if (pattern_match(ZERO_PATTERN, right, NULL)) {
         return left;
     } else if (ast_is_numeric(left) && ast_is_numeric(right)) {
-        return interp(ip, REAL(ast_to_f64(left)-ast_to_f64(right)));
+        return interp_real(ip, ast_to_f64(left)-ast_to_f64(right));
     }
 
     return SUB(left, right);
 }
 
 AST* interp_binop_mul(Interp *ip, AST *left, AST *right) {
-    if (ast_is_fraction(left) && right->type == AST_INTEGER) {
-        // a/b * c
-        AST *a = left->binop.left;
-        AST *b = left->binop.right;
-        AST *c = right;
-        AST *num = interp(ip, MUL(a, c));
-        AST *den = b;
-        return interp(ip, DIV(num, den));
-    } else if (left->type == AST_INTEGER && ast_is_fraction(right)) {
-        return interp_binop_mul(ip, right, left);
-    } else if (ast_match(left, INTEGER(0)) || ast_match(INTEGER(0), right)) {
-        return INTEGER(0);
+    if (ast_is_rational(left) && ast_is_rational(right)) {
+        return interp_rational_binop(ip, left, right, OP_MUL);
+    }
+
+    if (pattern_match(ZERO_PATTERN, left, NULL) || pattern_match(ZERO_PATTERN, right, NULL)) {
+        return &ast_zero;
     } else if (ast_match(left, right)) {
-        return interp_binop_pow(ip, left, INTEGER(2));
-    } else if (ast_is_fraction(left) && ast_is_fraction(right)) {
-        //   a/b * c/d
-        // = ac/bd
-        AST *a = left->binop.left;
-        AST *b = left->binop.right;
-        AST *c = right->binop.left;
-        AST *d = right->binop.right;
-        return interp(ip, DIV(MUL(a, c), MUL(b, d)));
-    } else if (ast_match(left, INTEGER(1)) || ast_match(right, INTEGER(1))) {
-        if (ast_match(left, INTEGER(1))) {
-            return right;
-        } else {
-            return left;
-        }
+        return interp_binop_pow(ip, left, &ast_two);
+    } else if (pattern_match(ONE_PATTERN, left, NULL)) {
+        return right;
+    } else if (pattern_match(ONE_PATTERN, right, NULL)) {
+        return left;
     } else if (ast_is_numeric(left) && ast_is_numeric(right)) {
-        return interp(ip, REAL(ast_to_f64(left)*ast_to_f64(right)));
+        return interp_real(ip, ast_to_f64(left)*ast_to_f64(right));
     }
 
     // x^n * x
-    if (left->type == AST_BINOP) {
-        if (left->binop.op == OP_POW) {
-            AST *x = left->binop.left;
-            AST *n = left->binop.right;
-            if (ast_match(x, right)) {
-                AST *result = POW(x, ADD(n, INTEGER(1)));
-                return interp(ip, result);
-            }
-        }
+    AST *bindings[PATTERN_MAX_SLOTS] = {0};
+    if (pattern_match(POW_PATTERN, left, bindings) && ast_match(bindings[1], right)) {
+        AST *x = bindings[1];
+        AST *n = bindings[2];
+        AST *result = POW(x, ADD(n, &ast_one));
+        return interp(ip, result);
     }
 
     return MUL(left, right);
 }
 
 AST* interp_binop_div(Interp *ip, AST *left, AST *right) {
-    assert(!ast_match(right, INTEGER(0))); // zero division
+    assert(!pattern_match(ZERO_PATTERN, right, NULL)); // zero division
 
-    if (left->type == AST_INTEGER && right->type == AST_INTEGER) {
-        if (left->integer.value % right->integer.value == 0) {
-            return INTEGER(left->integer.value / right->integer.value);
-        } else {
-            return DIV(left, right);
-        }
+    if (ast_is_rational(left) && ast_is_rational(right)) {
+        return interp_rational_binop(ip, left, right, OP_DIV);
     } else if (ast_is_numeric(left) && ast_is_numeric(right)) {
         f64 l = ast_to_f64(left);
         f64 r = ast_to_f64(right);
-        return interp(ip, REAL(l/r));
-    } else if (left->type == AST_INTEGER && right->type == AST_BINOP && right->binop.op == OP_DIV) {
-        return interp_binop_div(ip, MUL(left, right->binop.left), right->binop.right);
+        return interp_real(ip, l/r);
     }
     return DIV(left, right);
 }
 
 AST *interp_binop_pow(Interp *ip, AST *left, AST *right) {
-    if (ast_match(right, INTEGER(0))) {
-        return INTEGER(1);
-    } else if (ast_match(right, INTEGER(1))) {
-        return left;
+    if (ast_is_rational(left) && ast_is_integer(right)) {
+        return interp_rational_binop(ip, left, right, OP_POW);
     } else if (ast_is_numeric(left) && ast_is_numeric(right)) {
         f64 l = ast_to_f64(left);
         f64 r = ast_to_f64(right);
-        return interp(ip, REAL(pow(l, r)));
+        return interp_real(ip, pow(l, r));
     }
 
     return POW(left, right);
 }
 
 AST *interp_binop_mod(Interp *ip, AST *left, AST *right) {
-    if (left->type == AST_INTEGER && right->type == AST_INTEGER) {
-        i64 a = left->integer.value;
-        i64 b = right->integer.value;
-        return INTEGER(a%b);
+    // there is no remainder modulo zero, so x % 0 stays as it is
+    if (ast_is_integer(left) && ast_is_integer(right) && !pattern_match(ZERO_PATTERN, right, NULL)) {
+        return interp_integer_binop(ip, left, right, OP_MOD);
     }
 
     return MOD(left, right);
 }
 
-AST* interp_binop(Interp *ip, AST *left, AST *right, OpType op) {
+// Sums and products are handled n-ary. The whole chain is flattened into terms (or
+// factors), numbers are folded with the binary rules above, everything else is split
+// into coefficient and rest (or base and exponent), sorted and merged in one pass. So
+// collecting like terms of n operands is O(n log n) and doesn't depend on their order.
+typedef struct {
+    AST *rest; // the term without coefficient, or the base of a factor
+    AST *scale; // coefficient of a term, exponent of a factor
+    usize index; // position in the input, keeps the sort stable
+} Operand;
+
+typedef struct {
+    Operand *data;
+    usize size;
+    usize capacity;
+    AST *number; // all numeric operands folded together, NULL if there are none
+} Operands;
+
+void operands_append(Interp *ip, Operands *operands, AST *rest, AST *scale) {
+    if (operands->size == operands->capacity) {
+        usize new_capacity = operands->capacity == 0 ? 16 : operands->capacity*2;
+        operands->data = resize_array(ip->allocator, Operand, operands->data, operands->capacity, new_capacity);
+        operands->capacity = new_capacity;
+    }
+    operands->data[operands->size] = (Operand){ rest, scale, operands->size };
+    operands->size += 1;
+}
+
+int operand_compare(const void *a, const void *b) {
+    const Operand *l = a;
+    const Operand *r = b;
+    i32 result = ast_compare(l->rest, r->rest);
+    if (result != 0) {
+        return result;
+    }
+    return l->index < r->index ? -1 : l->index > r->index;
+}
+
+// sorts the operands and merges the ones with equal rest by adding their scales
+void operands_merge(Interp *ip, Operands *operands) {
+    if (operands->size == 0) {
+        return;
+    }
+
+    qsort(operands->data, operands->size, sizeof(Operand), operand_compare);
+
+    usize count = 1;
+    for (usize i = 1; i < operands->size; i++) {
+        Operand *last = &operands->data[count-1];
+        if (ast_match(last->rest, operands->data[i].rest)) {
+            last->scale = interp_binop_add(ip, last->scale, operands->data[i].scale);
+        } else {
+            operands->data[count++] = operands->data[i];
+        }
+    }
+    operands->size = count;
+}
+
+bool ast_is_zero(AST *node) {
+    return ast_is_numeric(node) && ast_to_f64(node) == 0.0;
+}
+
+void add_term(Interp *ip, Operands *terms, AST *term, bool negative) {
+    if (ast_is_numeric(term)) {
+        if (terms->number == NULL) {
+            terms->number = negative ? interp_binop_mul(ip, &ast_minus_one, term) : term;
+        } else if (negative) {
+            terms->number = interp_binop_sub(ip, terms->number, term);
+        } else {
+            terms->number = interp_binop_add(ip, terms->number, term);
+        }
+        return;
+    }
+
+    AST *coefficient = &ast_one;
+    if (term->type == AST_BINOP && term->binop.op == OP_MUL && ast_is_numeric(term->binop.left)) {
+        coefficient = term->binop.left;
+        term = term->binop.right;
+    }
+    if (negative) {
+        coefficient = interp_binop_mul(ip, &ast_minus_one, coefficient);
+    }
+    operands_append(ip, terms, term, coefficient);
+}
+
+// collects the terms of an already evaluated expression
+void collect_terms(Interp *ip, Operands *terms, AST *node, bool negative) {
+    if (node->type == AST_BINOP && (node->binop.op == OP_ADD || node->binop.op == OP_SUB)) {
+        collect_terms(ip, terms, node->binop.left, negative);
+        collect_terms(ip, terms, node->binop.right, node->binop.op == OP_SUB ? !negative : negative);
+    } else if (node->type == AST_UNARYOP && node->unaryop.op == OP_USUB && !ast_is_numeric(node->unaryop.operand)) {
+        collect_terms(ip, terms, node->unaryop.operand, !negative);
+    } else {
+        add_term(ip, terms, node, negative);
+    }
+}
+
+// appends coefficient*rest to the sum result (NULL if it's empty), a term with a negative
+// coefficient is subtracted, rest is NULL for the number
+AST *sum_append(Interp *ip, AST *result, AST *rest, AST *coefficient) {
+    if (ast_is_zero(coefficient)) {
+        return result;
+    }
+
+    bool is_negative = ast_to_f64(coefficient) < 0.0;
+    if (is_negative) {
+        coefficient = interp_binop_mul(ip, &ast_minus_one, coefficient);
+    }
+    AST *term = coefficient;
+    if (rest != NULL) {
+        term = pattern_match(ONE_PATTERN, coefficient, NULL) ? rest : MUL(coefficient, rest);
+    }
+
+    if (result == NULL) {
+        return is_negative ? init_ast_unaryop(ip->allocator, term, OP_USUB) : term;
+    }
+    return is_negative ? SUB(result, term) : ADD(result, term);
+}
+
+// builds the canonical sum of the collected terms
+AST *terms_to_ast(Interp *ip, Operands *terms) {
+    operands_merge(ip, terms);
+
+    // the sum starts with its first positive term, 2-x rather than -x+2
+    usize lead = terms->size;
+    for (usize i = 0; i < terms->size; i++) {
+        if (ast_to_f64(terms->data[i].scale) > 0.0) {
+            lead = i;
+            break;
+        }
+    }
+
+    AST *number = terms->number;
+    AST *result = NULL;
+    if (lead < terms->size) {
+        result = sum_append(ip, NULL, terms->data[lead].rest, terms->data[lead].scale);
+    } else if (number != NULL && ast_to_f64(number) > 0.0) {
+        result = number;
+        number = NULL;
+    }
+
+    for (usize i = 0; i < terms->size; i++) {
+        if (i != lead) {
+            result = sum_append(ip, result, terms->data[i].rest, terms->data[i].scale);
+        }
+    }
+
+    if (result == NULL) {
+        return number != NULL ? number : &ast_zero;
+    } else if (number == NULL) {
+        return result;
+    }
+    return sum_append(ip, result, NULL, number);
+}
+
+AST *interp_terms(Interp *ip, AST *node) {
+    // walk down the left spine without recursion, sums are left-deep and can be long
+    usize count = 0;
+    for (AST *n = node; n->type == AST_BINOP && (n->binop.op == OP_ADD || n->binop.op == OP_SUB); n = n->binop.left) {
+        count += 1;
+    }
+
+    AST **operands = alloc_array(ip->allocator, AST*, count+1);
+    bool *negative = alloc_array(ip->allocator, bool, count+1);
+    AST *n = node;
+    for (usize i = count; i > 0; i--) {
+        operands[i] = n->binop.right;
+        negative[i] = n->binop.op == OP_SUB;
+        n = n->binop.left;
+    }
+    operands[0] = n;
+    negative[0] = false;
 
     // depth first
-    left = interp(ip, left);
-    right = interp(ip, right);
+    Operands terms = {0};
+    for (usize i = 0; i <= count; i++) {
+        collect_terms(ip, &terms, interp(ip, operands[i]), negative[i]);
+    }
+
+    return terms_to_ast(ip, &terms);
+}
+
+void add_factor(Interp *ip, Operands *factors, AST *factor) {
+    if (ast_is_numeric(factor)) {
+        factors->number = factors->number == NULL ? factor : interp_binop_mul(ip, factors->number, factor);
+    } else if (factor->type == AST_BINOP && factor->binop.op == OP_MUL) {
+        add_factor(ip, factors, factor->binop.left);
+        add_factor(ip, factors, factor->binop.right);
+    } else if (factor->type == AST_UNARYOP && factor->unaryop.op == OP_USUB) {
+        add_factor(ip, factors, &ast_minus_one);
+        add_factor(ip, factors, factor->unaryop.operand);
+    } else if (factor->type == AST_BINOP && factor->binop.op == OP_POW) {
+        operands_append(ip, factors, factor->binop.left, factor->binop.right);
+    } else {
+        operands_append(ip, factors, factor, &ast_one);
+    }
+}
+
+// builds the canonical product of the collected factors
+AST *factors_to_ast(Interp *ip, Operands *factors) {
+    AST *number = factors->number;
+    if (number != NULL && ast_is_zero(number)) {
+        return &ast_zero;
+    }
+
+    // x^a * x^b -> x^(a+b)
+    operands_merge(ip, factors);
+
+    AST *result = NULL;
+    for (usize i = 0; i < factors->size; i++) {
+        AST *factor = simplify_binop(ip, factors->data[i].rest, factors->data[i].scale, OP_POW);
+        if (pattern_match(ONE_PATTERN, factor, NULL)) {
+            continue;
+        }
+        result = result == NULL ? factor : MUL(result, factor);
+    }
+
+    if (result == NULL) {
+        return number != NULL ? number : &ast_one;
+    } else if (number == NULL || pattern_match(ONE_PATTERN, number, NULL)) {
+        return result;
+    } else if (pattern_match(MINUS_ONE_PATTERN, number, NULL)) {
+        return init_ast_unaryop(ip->allocator, result, OP_USUB);
+    }
+    return MUL(number, result);
+}
+
+AST *interp_factors(Interp *ip, AST *node) {
+    usize count = 0;
+    for (AST *n = node; n->type == AST_BINOP && n->binop.op == OP_MUL; n = n->binop.left) {
+        count += 1;
+    }
+
+    AST **operands = alloc_array(ip->allocator, AST*, count+1);
+    AST *n = node;
+    for (usize i = count; i > 0; i--) {
+        operands[i] = n->binop.right;
+        n = n->binop.left;
+    }
+    operands[0] = n;
+
+    // depth first
+    Operands factors = {0};
+    for (usize i = 0; i <= count; i++) {
+        add_factor(ip, &factors, interp(ip, operands[i]));
+    }
+
+    return factors_to_ast(ip, &factors);
+}
+
+// simplifies a binop whose operands are already evaluated
+AST *simplify_binop(Interp *ip, AST *left, AST *right, OpType op) {
+    // the rule table first (see rewrite.c), then the rules which need computation
+    AST node = { .type = AST_BINOP, .binop = { left, right, op } };
+    AST *rewritten = rewrite_node(ip, &node);
+    if (rewritten != NULL) {
+        return rewritten;
+    }
 
     switch (op) {
         case OP_ADD: return interp_binop_add(ip, left, right);
@@ -522,14 +1036,29 @@ AST* interp_binop(Interp *ip, AST *left, AST *right, OpType op) {
     }
 }
 
+AST* interp_binop(Interp *ip, AST *left, AST *right, OpType op) {
+
+    // depth first
+    left = interp(ip, left);
+    right = interp(ip, right);
+
+    return simplify_binop(ip, left, right, op);
+}
+
 AST* interp_unaryop(Interp *ip, OpType op, AST *operand) {
     operand = interp(ip, operand);
 
-    if (op == OP_UADD) {
-        return operand;
+    AST node = { .type = AST_UNARYOP, .unaryop = { operand, op } };
+    AST *rewritten = rewrite_node(ip, &node);
+    if (rewritten != NULL) {
+        return rewritten;
+    }
+
+    if (ast_is_rational(operand) && op == OP_USUB) {
+        return interp_rational_binop(ip, &ast_zero, operand, OP_SUB);
     } else if (ast_is_numeric(operand)) {
         f64 value = ast_to_f64(operand);
-        return interp(ip, REAL(-value));
+        return interp_real(ip, -value);
     }
 
     return init_ast_unaryop(ip->allocator, operand, op);
@@ -539,9 +1068,9 @@ AST* diff(Interp *ip, AST *expr, AST *var) {
     switch (expr->type) {
         case AST_SYMBOL: {
             if (ast_match(expr, var)) {
-                return INTEGER(1);
+                return &ast_one;
             } else {
-                return INTEGER(0);
+                return &ast_zero;
             }
         }
         case AST_BINOP: {
@@ -553,7 +1082,7 @@ AST* diff(Interp *ip, AST *expr, AST *var) {
                     AST* b = expr->binop.left;
                     AST* n = expr->binop.right;
                     // x^n -> n * x^(n-1) * x'
-                    return interp_binop_mul(ip, MUL(n, POW(b, SUB(n, INTEGER(1)))), diff(ip, b, var));
+                    return interp_binop_mul(ip, MUL(n, POW(b, SUB(n, &ast_one))), diff(ip, b, var));
                 }
                 case OP_ADD: {
                     // a + b -> a' + b'
@@ -573,112 +1102,105 @@ AST* diff(Interp *ip, AST *expr, AST *var) {
 }
 
 AST *interp_sin(Interp *ip, AST* x) {
-    if (ast_match(x, CONSTANT(init_string("pi")))) {
-        return INTEGER(0);
-    } else if (ast_is_numeric(x)) {
+    if (ast_is_numeric(x)) {
         f64 value = ast_to_f64(x);
-        return interp(ip, REAL(sin(value)));
+        return interp_real(ip, sin(value));
     }
     
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("sin"), args);
+    return CALL(BUILTIN_SIN, args);
 }
 
 AST *interp_cos(Interp *ip, AST* x) {    
-    if (ast_match(x, INTEGER(0))) {
-        return INTEGER(1);
-    } else if (ast_match(x, DIV(CONSTANT(init_string("pi")), INTEGER(2)))) {
-        return INTEGER(0);
-    } else if (ast_match(x, CONSTANT(init_string("pi")))) {
-        return INTEGER(-1);
-    } else if (ast_is_numeric(x)) {
+    if (ast_is_numeric(x)) {
         f64 value = ast_to_f64(x);
-        return interp(ip, REAL(cos(value)));
+        return interp_real(ip, cos(value));
     }
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("cos"), args);
+    return CALL(BUILTIN_COS, args);
 }
 
 AST *interp_tan(Interp *ip, AST* x) {
     if (ast_is_numeric(x)) {
         f64 value = ast_to_f64(x);
-        return interp(ip, REAL(tan(value)));
+        return interp_real(ip, tan(value));
     }
     
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("tan"), args);
+    return CALL(BUILTIN_TAN, args);
 }
 
 AST *interp_asin(Interp *ip, AST* x) {
     if (ast_is_numeric(x)) {
         f64 value = ast_to_f64(x);
-        return interp(ip, REAL(asin(value)));
+        return interp_real(ip, asin(value));
     }
     
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("asin"), args);
+    return CALL(BUILTIN_ASIN, args);
 }
 
 AST *interp_acos(Interp *ip, AST* x) {
     if (ast_is_numeric(x)) {
         f64 value = ast_to_f64(x);
-        return interp(ip, REAL(acos(value)));
+        return interp_real(ip, acos(value));
     }
     
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("acos"), args);
+    return CALL(BUILTIN_ACOS, args);
 }
 
 AST *interp_atan(Interp *ip, AST* x) {
     if (ast_is_numeric(x)) {
         f64 value = ast_to_f64(x);
-        return interp(ip, REAL(atan(value)));
+        return interp_real(ip, atan(value));
     }
     
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("atan"), args);
+    return CALL(BUILTIN_ATAN, args);
 }
 
 AST *interp_abs(Interp *ip, AST* x) {
-    if (ast_is_numeric(x)) {
+    if (ast_is_rational(x)) {
+        // the sign of a rational is the sign of its numerator
+        AST *numerator = x->type == AST_RATIONAL ? x->rational.numerator : x;
+        return ast_to_f64(numerator) < 0 ? interp_rational_binop(ip, &ast_zero, x, OP_SUB) : x;
+    } else if (ast_is_numeric(x)) {
         f64 value = ast_to_f64(x);
         if (value < 0) {
-            return interp(ip, REAL(-value));
+            return interp_real(ip, -value);
         } else {
-            return interp(ip, REAL(value));
+            return interp_real(ip, value);
         }
     }
     
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("abs"), args);
+    return CALL(BUILTIN_ABS, args);
 }
 
 AST *interp_factorial(Interp *ip, AST *n) {
-    // 0!
-    if (ast_match(n, INTEGER(0))) {
-        return INTEGER(1);
-    }
-
     if (n->type == AST_INTEGER) {
         i64 value = n->integer.value;
 
         // TODO: error handling
-        assert(value > 0);
+        assert(value >= 0);
 
-        return interp(ip, INTEGER(factorial(value)));
+        if (value <= BIGNUM_MAX_FACTORIAL) {
+            return BIGINT(bignum_factorial(ip->allocator, value));
+        }
     }
     
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, n);
-    return CALL(init_string("factorial"), args);
+    return CALL(BUILTIN_FACTORIAL, args);
 }
 
 AST *interp_npr(Interp *ip, AST *n, AST *k) {
@@ -692,13 +1214,13 @@ AST *interp_npr(Interp *ip, AST *n, AST *k) {
         assert(k_value >= 0);
         assert(k_value <= n_value);
 
-        return interp(ip, DIV(INTEGER(factorial(n_value)), INTEGER(factorial(n_value-k_value))));
+        return BIGINT(bignum_permutations(ip->allocator, n_value, k_value));
     }
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, n);
     ast_array_append(ip->allocator, &args, k);
-    return CALL(init_string("npr"), args);
+    return CALL(BUILTIN_NPR, args);
 }
 
 AST *interp_ncr(Interp *ip, AST *n, AST *k) {
@@ -712,56 +1234,113 @@ AST *interp_ncr(Interp *ip, AST *n, AST *k) {
         assert(k_value >= 0);
         assert(k_value <= n_value);
 
-        AST *nominator = INTEGER(factorial(n_value));
-        AST *denominator = MUL(INTEGER(factorial(n_value-k_value)), INTEGER(factorial(k_value)));
-
-        return interp(ip, DIV(nominator, denominator));
+        return BIGINT(bignum_binomial(ip->allocator, n_value, k_value));
     }
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, n);
     ast_array_append(ip->allocator, &args, k);
-    return CALL(init_string("ncr"), args);
+    return CALL(BUILTIN_NCR, args);
 }
 
 AST *interp_gcd(Interp *ip, AST *a_ast, AST *b_ast) {
     // TODO: implement multiple args for this function (see python math module) @same20240626
     
     if (a_ast->type == AST_INTEGER && b_ast->type == AST_INTEGER) {
-        return INTEGER(gcd(a_ast->integer.value, b_ast->integer.value));
+        // Euclidean algorithm - https://en.wikipedia.org/wiki/Euclidean_algorithm
+        // on the magnitudes, gcd(INT64_MIN, 0) = 2^63 doesn't fit into an i64
+        i64 a = a_ast->integer.value;
+        i64 b = b_ast->integer.value;
+        u64 result = u64_gcd(a < 0 ? -(u64)a : (u64)a, b < 0 ? -(u64)b : (u64)b);
+        return interp_u64(ip, result);
+    } else if (ast_is_integer(a_ast) && ast_is_integer(b_ast)) {
+        Bignum a = ast_to_bignum(ip->allocator, a_ast);
+        Bignum b = ast_to_bignum(ip->allocator, b_ast);
+        return BIGINT(bignum_gcd(ip->allocator, a, b));
     }
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, a_ast);
     ast_array_append(ip->allocator, &args, b_ast);
-    return CALL(init_string("gcd"), args);
+    return CALL(BUILTIN_GCD, args);
 }
 
 AST *interp_lcm(Interp *ip, AST *a_ast, AST *b_ast) {
     // TODO: implement multiple args for this function (see python math module) @same20240626
 
-    if (a_ast->type == AST_INTEGER && b_ast->type == AST_INTEGER) {
+    if (ast_is_integer(a_ast) && ast_is_integer(b_ast)) {
         // LCM formula - https://en.wikipedia.org/wiki/Least_common_multiple
-        i64 a = a_ast->integer.value;
-        i64 b = b_ast->integer.value;
-        i64 result = llabs(a*b) / gcd(a, b);
-        return INTEGER(result);
+        // |a*b|/gcd(a, b), divided first so it only overflows if the result does
+        AST *divisor = interp_gcd(ip, a_ast, b_ast);
+        if (pattern_match(ZERO_PATTERN, divisor, NULL)) {
+            return &ast_zero;
+        }
+        AST *result = interp_integer_binop(ip, interp_integer_binop(ip, a_ast, divisor, OP_DIV), b_ast, OP_MUL);
+        return interp_abs(ip, result);
     }
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, a_ast);
     ast_array_append(ip->allocator, &args, b_ast);
-    return CALL(init_string("lcm"), args);
+    return CALL(BUILTIN_LCM, args);
+}
+
+AST *interp_factor(Interp *ip, AST *n) {
+    // n = p1^e1*...*pk^ek, wrapped in an AST_FACTORED so later arithmetic can't fold it
+    u64 value;
+    if (ast_is_integer(n) && ast_to_u64(interp_abs(ip, n), &value)) {
+        if (value <= 1) {
+            return n;
+        }
+
+        Factorization factorization = u64_factor(value);
+        AST *result = NULL;
+        for (usize i = 0; i < factorization.count; i++) {
+            AST *factor = interp_u64(ip, factorization.primes[i]);
+            if (factorization.exponents[i] > 1) {
+                factor = POW(factor, INTEGER(factorization.exponents[i]));
+            }
+            result = result == NULL ? factor : MUL(result, factor);
+        }
+        return FACTORED(ast_match(n, interp_abs(ip, n)) ? result : MUL(&ast_minus_one, result));
+    }
+
+    ASTArray args = {0};
+    ast_array_append(ip->allocator, &args, n);
+    return CALL(BUILTIN_FACTOR, args);
+}
+
+AST *interp_isprime(Interp *ip, AST *n) {
+    // 1 or 0, negative numbers are never prime
+    u64 value;
+    if (ast_to_u64(n, &value)) {
+        return u64_is_prime(value) ? &ast_one : &ast_zero;
+    } else if (ast_is_integer(n) && !ast_match(n, interp_abs(ip, n))) {
+        return &ast_zero;
+    }
+
+    ASTArray args = {0};
+    ast_array_append(ip->allocator, &args, n);
+    return CALL(BUILTIN_ISPRIME, args);
+}
+
+AST *interp_nextprime(Interp *ip, AST *n) {
+    // the smallest prime > n
+    u64 value, prime;
+    if (ast_to_u64(n, &value) && u64_next_prime(value, &prime)) {
+        return interp_u64(ip, prime);
+    } else if (ast_is_integer(n) && !ast_match(n, interp_abs(ip, n))) {
+        return &ast_two;
+    }
+
+    ASTArray args = {0};
+    ast_array_append(ip->allocator, &args, n);
+    return CALL(BUILTIN_NEXTPRIME, args);
 }
 
 AST *interp_log(Interp *ip, AST *y, AST *b) {
     // log_b(y) = x
     // b^x = y
-    if (ast_match(y, INTEGER(1))) {
-        return INTEGER(0);
-    } else if (ast_match(y, b)) {
-        return INTEGER(1);
-    }
 
     // compute
     if (ast_is_numeric(y) && ast_is_numeric(b)) {
@@ -776,8 +1355,7 @@ AST *interp_log(Interp *ip, AST *y, AST *b) {
         //       base change formula.
         //
         // base change
-        AST *result = REAL(log(y_value) / log(b_value));
-        return interp(ip, result);
+        return interp_real(ip, log(y_value) / log(b_value));
     }
 
     // TODO: implement maybe variadic function or macro to simplify ast array
@@ -785,41 +1363,43 @@ AST *interp_log(Interp *ip, AST *y, AST *b) {
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, y);
     ast_array_append(ip->allocator, &args, b);
-    return CALL(init_string("log"), args);
+    return CALL(BUILTIN_LOG, args);
 }
 
 AST* interp_sqrt(Interp *ip, AST *x) {
-    // check for perfect square for simplifying
-    //
-    // TODO: this is probably an inefficient way to compute the biggest perfect sqaure factor of a given number
-    if (x->type == AST_INTEGER) {
-        for (i32 q = x->integer.value; q > 1; q--) {
-            double sqrt_of_q = sqrtf((double)q);
-            bool is_perfect_square = sqrt_of_q == floor(sqrt_of_q);
-            if (is_perfect_square && x->integer.value % q == 0) {
-                i32 p = x->integer.value / q;
-                ASTArray new_args = {0};
-                ast_array_append(ip->allocator, &new_args, INTEGER(p));
-                AST *result = MUL(INTEGER((i64)sqrt_of_q), CALL(init_string("sqrt"), new_args));
-                return interp(ip, result);
-            }
-        }
+    // sqrt(n) = a*sqrt(b) with a square-free b
+    AST *outside = NULL;
+    AST *inside = NULL;
+    if (x->type == AST_INTEGER && x->integer.value > 0) {
+        u64 a, b;
+        u64_square_free(x->integer.value, &a, &b);
+        outside = INTEGER(a);
+        inside = INTEGER(b);
+    } else if (x->type == AST_BIGINT && !x->bigint.value.negative) {
+        Bignum a, b;
+        bignum_square_free(ip->allocator, x->bigint.value, &a, &b);
+        outside = BIGINT(a);
+        inside = BIGINT(b);
     }
 
-    // sqrt(1)
-    if (ast_match(x, INTEGER(1))) {
-        return INTEGER(1);
+    if (outside != NULL && !ast_match(outside, &ast_one)) {
+        if (ast_match(inside, &ast_one)) {
+            return outside;
+        }
+        ASTArray new_args = {0};
+        ast_array_append(ip->allocator, &new_args, inside);
+        return interp_binop_mul(ip, outside, CALL(BUILTIN_SQRT, new_args));
     }
 
     // compute
     // if (ast_is_numeric(x)) {
     //     f64 value = ast_to_f64(x);
-    //     return interp(ip, REAL(sqrt(value)));
+    //     return interp_real(ip, sqrt(value));
     // }
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("sqrt"), args);
+    return CALL(BUILTIN_SQRT, args);
 }
 
 AST *interp_floor(Interp *ip, AST *x) {
@@ -830,7 +1410,7 @@ AST *interp_floor(Interp *ip, AST *x) {
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("floor"), args);
+    return CALL(BUILTIN_FLOOR, args);
 }
 
 AST *interp_ceil(Interp *ip, AST *x) {
@@ -841,146 +1421,332 @@ AST *interp_ceil(Interp *ip, AST *x) {
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, x);
-    return CALL(init_string("ceil"), args);
+    return CALL(BUILTIN_CEIL, args);
 }
 
 AST *interp_sum(Interp *ip, AST *v) {
     if (v->type == AST_LIST) {
-        AST *result = INTEGER(0);
+        Operands terms = {0};
         for (usize i = 0; i < v->list.nodes.size; i++) {
-            result = ADD(result, v->list.nodes.data[i]);
+            collect_terms(ip, &terms, interp(ip, v->list.nodes.data[i]), false);
         }
-        return interp(ip, result);
+        return terms_to_ast(ip, &terms);
     }
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, v);
-    return CALL(init_string("sum"), args);
+    return CALL(BUILTIN_SUM, args);
 }
 
 AST *interp_prod(Interp *ip, AST *v) {
     if (v->type == AST_LIST) {
-        AST *result = INTEGER(1);
+        Operands factors = {0};
         for (usize i = 0; i < v->list.nodes.size; i++) {
-            result = MUL(result, v->list.nodes.data[i]);
+            add_factor(ip, &factors, interp(ip, v->list.nodes.data[i]));
         }
-        return interp(ip, result);
+        return factors_to_ast(ip, &factors);
     }
 
     ASTArray args = {0};
     ast_array_append(ip->allocator, &args, v);
-    return CALL(init_string("prod"), args);
+    return CALL(BUILTIN_PROD, args);
 }
 
-AST* interp_call(Interp *ip, String name, ASTArray args) {
+AST* interp_call(Interp *ip, BuiltinFunction function, ASTArray args) {
 
-    // depth first
-    for (usize i = 0; i < args.size; i++) {
-        args.data[i] = interp(ip, args.data[i]);
+    // depth first, into a new array because the parsed tree must stay untouched
+    ASTArray parsed_args = args;
+    args = init_ast_array_with_capacity(ip->allocator, parsed_args.size);
+    for (usize i = 0; i < parsed_args.size; i++) {
+        ast_array_append(ip->allocator, &args, interp(ip, parsed_args.data[i]));
     }
 
-    // check for builtin function and right signature
-    if (is_builtin_function(name)) {
-        bool success = check_builtin_function_signature(name, args);
-        if (!success) {
-            panic("Wrong amount of arguments.");
-        }
+    // check for right signature
+    bool success = check_builtin_function_signature(function, args);
+    if (!success) {
+        panic("Wrong amount of arguments.");
     }
     // Since here we know that the amount of args for any builtin
     // function is right so we dont need any further checks for now.
     // Maybe this will change in the future if we introduce any kind
     // of typing in the function signatures.
 
-    if (string_eq(name, init_string("sqrt"))) {
-        return interp_sqrt(ip, args.data[0]);
-    } else if (string_eq(name, init_string("ln"))) {
-        return interp_log(ip, args.data[0], CONSTANT(init_string("e")));
-    } else if (string_eq(name, init_string("log"))) {
-        return interp_log(ip, args.data[0], args.data[1]);
-    } else if (string_eq(name, init_string("sin"))) {
-        return interp_sin(ip, args.data[0]);
-    } else if (string_eq(name, init_string("cos"))) {
-        return interp_cos(ip, args.data[0]);
-    } else if (string_eq(name, init_string("tan"))) {
-        return interp_tan(ip, args.data[0]);
-    } else if (string_eq(name, init_string("asin"))) {
-        return interp_asin(ip, args.data[0]);
-    } else if (string_eq(name, init_string("acos"))) {
-        return interp_acos(ip, args.data[0]);
-    } else if (string_eq(name, init_string("atan"))) {
-        return interp_atan(ip, args.data[0]);
-    } else if (string_eq(name, init_string("abs"))) {
-        return interp_abs(ip, args.data[0]);
-    } else if (string_eq(name, init_string("factorial"))) {
-        return interp_factorial(ip, args.data[0]);
-    } else if (string_eq(name, init_string("npr"))) {
-        return interp_npr(ip, args.data[0], args.data[1]);
-    } else if (string_eq(name, init_string("ncr"))) {
-        return interp_ncr(ip, args.data[0], args.data[1]);
-    } else if (string_eq(name, init_string("gcd"))) {
-        return interp_gcd(ip, args.data[0], args.data[1]);
-    } else if (string_eq(name, init_string("lcm"))) {
-        return interp_lcm(ip, args.data[0], args.data[1]);
-    } else if (string_eq(name, init_string("pow"))) {
-        return interp(ip, POW(args.data[0], args.data[1]));
-    } else if (string_eq(name, init_string("exp"))) {
-        return interp(ip, POW(CONSTANT(init_string("e")), args.data[0]));
-    } else if (string_eq(name, init_string("floor"))) {
-        return interp_floor(ip, args.data[0]);
-    } else if (string_eq(name, init_string("ceil"))) {
-        return interp_ceil(ip, args.data[0]);
-    } else if (string_eq(name, init_string("sum"))) {
-        return interp_sum(ip, args.data[0]);
-    } else if (string_eq(name, init_string("prod"))) {
-        return interp_prod(ip, args.data[0]);
-    } else if (string_eq(name, init_string("diff"))) {
-        AST* diff_var;
-
-        if (args.size == 1) {
-            ASTArray nodes = ast_to_flat_array(ip->allocator, args.data[0]);
-            bool symbol_seen = false;
-            AST *symbol;
-            for (usize i = 0; i < nodes.size; i++) {
-                if (nodes.data[i]->type == AST_SYMBOL) {
-                    if (symbol_seen) {
-                        assert(ast_match(symbol, nodes.data[i]));
-                    } else {
-                        symbol_seen = true;
-                        symbol = nodes.data[i];
+    AST node = { .type = AST_CALL, .func_call = { function, args } };
+    AST *rewritten = rewrite_node(ip, &node);
+    if (rewritten != NULL) {
+        return rewritten;
+    }
+
+    switch (function) {
+        case BUILTIN_SQRT: return interp_sqrt(ip, args.data[0]);
+        case BUILTIN_LN: return interp_log(ip, args.data[0], &ast_e);
+        case BUILTIN_LOG: return interp_log(ip, args.data[0], args.data[1]);
+        case BUILTIN_SIN: return interp_sin(ip, args.data[0]);
+        case BUILTIN_COS: return interp_cos(ip, args.data[0]);
+        case BUILTIN_TAN: return interp_tan(ip, args.data[0]);
+        case BUILTIN_ASIN: return interp_asin(ip, args.data[0]);
+        case BUILTIN_ACOS: return interp_acos(ip, args.data[0]);
+        case BUILTIN_ATAN: return interp_atan(ip, args.data[0]);
+        case BUILTIN_ABS: return interp_abs(ip, args.data[0]);
+        case BUILTIN_FACTORIAL: return interp_factorial(ip, args.data[0]);
+        case BUILTIN_NPR: return interp_npr(ip, args.data[0], args.data[1]);
+        case BUILTIN_NCR: return interp_ncr(ip, args.data[0], args.data[1]);
+        case BUILTIN_GCD: return interp_gcd(ip, args.data[0], args.data[1]);
+        case BUILTIN_LCM: return interp_lcm(ip, args.data[0], args.data[1]);
+        case BUILTIN_FACTOR: return interp_factor(ip, args.data[0]);
+        case BUILTIN_ISPRIME: return interp_isprime(ip, args.data[0]);
+        case BUILTIN_NEXTPRIME: return interp_nextprime(ip, args.data[0]);
+        case BUILTIN_POW: return interp(ip, POW(args.data[0], args.data[1]));
+        case BUILTIN_EXP: return interp(ip, POW(&ast_e, args.data[0]));
+        case BUILTIN_FLOOR: return interp_floor(ip, args.data[0]);
+        case BUILTIN_CEIL: return interp_ceil(ip, args.data[0]);
+        case BUILTIN_SUM: return interp_sum(ip, args.data[0]);
+        case BUILTIN_PROD: return interp_prod(ip, args.data[0]);
+        case BUILTIN_SIMPLIFY: return egraph_simplify(ip, args.data[0], EGRAPH_DEFAULT_BUDGET, NULL);
+        case BUILTIN_DIFF: {
+            AST* diff_var;
+
+            if (args.size == 1) {
+                ASTArray nodes = ast_to_flat_array(ip->allocator, args.data[0]);
+                bool symbol_seen = false;
+                AST *symbol;
+                for (usize i = 0; i < nodes.size; i++) {
+                    if (nodes.data[i]->type == AST_SYMBOL) {
+                        if (symbol_seen) {
+                            assert(ast_match(symbol, nodes.data[i]));
+                        } else {
+                            symbol_seen = true;
+                            symbol = nodes.data[i];
+                        }
                     }
                 }
+                assert(symbol_seen);
+                diff_var = symbol;
+            } else if (args.size == 2) {
+                assert(args.data[1]->type == AST_SYMBOL);
+                diff_var = args.data[1];
+            } else {
+                assert(false);
             }
-            assert(symbol_seen);
-            diff_var = symbol;
-        } else if (args.size == 2) {
-            assert(args.data[1]->type == AST_SYMBOL);
-            diff_var = args.data[1];
-        } else {
-            assert(false);
+
+            return diff(ip, args.data[0], diff_var);
         }
+        case BUILTIN_NONE:
+        case BUILTIN_FUNCTION_COUNT: break;
+    }
+
+    panic("unreachable");
+}
 
-        return diff(ip, args.data[0], diff_var);
+//
+// environment
+//
+
+#define ENVIRONMENT_MIN_CAPACITY 16
+
+usize environment_slot(Environment *env, String name) {
+    // names are interned, so the pointer is a unique key
+    u64 hash = (u64)(usize)name.str * 0x9E3779B97F4A7C15ull;
+    usize mask = env->capacity-1;
+    usize i = (hash >> 32) & mask;
+    while (env->variables[i].name.str != NULL && env->variables[i].name.str != name.str) {
+        i = (i+1) & mask;
     }
+    return i;
+}
+
+void environment_grow(Environment *env) {
+    Variable *old_variables = env->variables;
+    usize old_capacity = env->capacity;
+
+    env->capacity = old_capacity == 0 ? ENVIRONMENT_MIN_CAPACITY : old_capacity*2;
+    env->variables = calloc(env->capacity, sizeof(Variable));
+    assert(env->variables != NULL);
 
-    return CALL(name, args);
+    for (usize i = 0; i < old_capacity; i++) {
+        if (old_variables[i].name.str != NULL) {
+            env->variables[environment_slot(env, old_variables[i].name)] = old_variables[i];
+        }
+    }
+    free(old_variables);
 }
 
-AST *interp_symbol(Interp *ip, String name) {
+AST *environment_get(Environment *env, String name) {
+    // inner scopes shadow outer ones
+    for (; env != NULL; env = env->parent) {
+        if (env->count > 0) {
+            Variable *var = &env->variables[environment_slot(env, name)];
+            if (var->name.str != NULL) {
+                return var->value;
+            }
+        }
+    }
+    return NULL;
+}
 
-    // here comes the check for defined variables in the future
-    if (is_builtin_constant(name)) {
-        return CONSTANT(name);
+void environment_set(Environment *env, String name, AST *value) {
+    // keep the load factor below 3/4
+    if ((env->count+1)*4 > env->capacity*3) {
+        environment_grow(env);
     }
 
-    // check if its a defined variable
-    for (usize i = 0; i < ip->variables_count; i++) {
-        Variable var = ip->variables[i];
-        if (string_eq(name, var.name)) {
-            return var.value;
+    Variable *var = &env->variables[environment_slot(env, name)];
+    if (var->name.str == NULL) {
+        var->name = name;
+        env->count += 1;
+    }
+    // overwriting old value with new value
+    var->value = value;
+}
+
+void free_environment(Environment *env) {
+    free(env->variables);
+    env->variables = NULL;
+    env->capacity = 0;
+    env->count = 0;
+}
+
+Environment *interp_scope(Interp *ip) {
+    return ip->scope != NULL ? ip->scope : &ip->globals;
+}
+
+//
+// memo cache
+//
+
+#define MEMO_CAPACITY (2*MEMO_MAX_ENTRIES)
+
+// counts the nodes of a tree against budget, stops as soon as it runs out
+bool memo_small(AST *node, usize *budget) {
+    if (*budget == 0) {
+        return false;
+    }
+    *budget -= 1;
+    switch (node->type) {
+        case AST_BINOP: return memo_small(node->binop.left, budget) && memo_small(node->binop.right, budget);
+        case AST_UNARYOP: return memo_small(node->unaryop.operand, budget);
+        case AST_RATIONAL: return memo_small(node->rational.numerator, budget) && memo_small(node->rational.denominator, budget);
+        case AST_FACTORED: return memo_small(node->factored.product, budget);
+        case AST_CALL: {
+            for (usize i = 0; i < node->func_call.args.size; i++) {
+                if (!memo_small(node->func_call.args.data[i], budget)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case AST_LIST: {
+            for (usize i = 0; i < node->list.nodes.size; i++) {
+                if (!memo_small(node->list.nodes.data[i], budget)) {
+                    return false;
+                }
+            }
+            return true;
         }
+        default: return true;
     }
+}
 
-    return SYMBOL(name);
+bool memo_cacheable(AST *node) {
+    // leaves are cheaper to evaluate than to look up, assigns and programs have side effects
+    if (node->type != AST_BINOP && node->type != AST_UNARYOP && node->type != AST_CALL) {
+        return false;
+    }
+    usize budget = MEMO_MAX_NODES;
+    return memo_small(node, &budget);
+}
+
+usize memo_slot(MemoCache *memo, AST *key) {
+    usize i = key->hash & (MEMO_CAPACITY-1);
+    while (memo->entries[i].key != NULL && !ast_match(memo->entries[i].key, key)) {
+        i = (i+1) & (MEMO_CAPACITY-1);
+    }
+    return i;
+}
+
+AST *memo_get(MemoCache *memo, AST *key) {
+    if (memo->count == 0) {
+        return NULL;
+    }
+    return memo->entries[memo_slot(memo, key)].value;
+}
+
+void memo_put(MemoCache *memo, AST *key, AST *value) {
+    usize budget = MEMO_MAX_NODES;
+    if (memo->count >= MEMO_MAX_ENTRIES || value->type == AST_LIST || !memo_small(value, &budget)) {
+        // lists can still be appended to, everything else is immutable
+        return;
+    }
+
+    if (memo->entries == NULL) {
+        memo->entries = calloc(MEMO_CAPACITY, sizeof(MemoEntry));
+        assert(memo->entries != NULL);
+    }
+
+    MemoEntry *entry = &memo->entries[memo_slot(memo, key)];
+    if (entry->key == NULL) {
+        entry->key = ast_copy(&memo->allocator, key);
+        entry->value = ast_copy(&memo->allocator, value);
+        memo->count += 1;
+    }
+}
+
+void memo_invalidate(MemoCache *memo) {
+    // forget everything, e.g. after a variable changed
+    if (memo->count > 0) {
+        memset(memo->entries, 0, MEMO_CAPACITY*sizeof(MemoEntry));
+        memo->count = 0;
+        memo->stale = true;
+    }
+}
+
+void memo_end_statement(MemoCache *memo) {
+    // a full cache starts over, otherwise it would stop learning for the rest of the session
+    if (memo->count >= MEMO_MAX_ENTRIES) {
+        memo_invalidate(memo);
+    }
+    if (memo->stale && memo->count == 0) {
+        free_allocator(&memo->allocator);
+        memo->stale = false;
+    }
+}
+
+void free_memo_cache(MemoCache *memo) {
+    free_allocator(&memo->allocator);
+    free(memo->entries);
+    *memo = (MemoCache){0};
+}
+
+void interp_push_scope(Interp *ip) {
+    memo_invalidate(&ip->memo);
+
+    Environment *scope = calloc(1, sizeof(Environment));
+    assert(scope != NULL);
+    scope->parent = interp_scope(ip);
+    ip->scope = scope;
+}
+
+void interp_pop_scope(Interp *ip) {
+    assert(ip->scope != NULL); // the global scope can't be popped
+    memo_invalidate(&ip->memo);
+
+    Environment *scope = ip->scope;
+    ip->scope = scope->parent == &ip->globals ? NULL : scope->parent;
+    free_environment(scope);
+    free(scope);
+}
+
+AST *interp_symbol(Interp *ip, AST *node) {
+    // builtin constants are already turned into AST_CONSTANT by the parser
+
+    // check if its a defined variable
+    AST *value = environment_get(interp_scope(ip), node->symbol.name);
+    if (value != NULL) {
+        return value;
+    }
+
+    // nodes are never modified, so we can simply return the symbol itself
+    return node;
 }
 
 AST *interp_program(Interp *ip, ASTArray statements) {
@@ -988,10 +1754,29 @@ AST *interp_program(Interp *ip, ASTArray statements) {
         return EMPTY();
     }
 
+    assert(ip->persistent_allocator == NULL); // no nested programs
+
+    if (ip->allocator->cons != NULL) {
+        ip->scratch.cons = &ip->scratch_cons;
+    }
+
     AST *last_result = NULL;
     for (usize i = 0; i < statements.size; i++) {
+        // Every statement works in the scratch allocator. Only the result (and the
+        // values of assigned variables) are copied over, afterwards all the
+        // temporary nodes of the statement are thrown away.
+        ArenaMark mark = arena_mark(&ip->scratch);
+        ip->persistent_allocator = ip->allocator;
+        ip->allocator = &ip->scratch;
+
         // TODO: implement 'ans' here
-        last_result = interp(ip, statements.data[i]);
+        AST *result = interp(ip, statements.data[i]);
+
+        ip->allocator = ip->persistent_allocator;
+        ip->persistent_allocator = NULL;
+        last_result = ast_copy(ip->allocator, result);
+        arena_rewind(&ip->scratch, mark);
+        memo_end_statement(&ip->memo);
     }
 
     assert(last_result != NULL);
@@ -1007,57 +1792,72 @@ AST *interp_assign(Interp *ip, AST *target, AST *value) {
 
     String name = target->symbol.name;
 
-    // check if variable already exists
-    for (usize i = 0; i < ip->variables_count; i++) {
-        if (string_eq(name, ip->variables[i].name)) {
-            // overwriting old value with new value
-            ip->variables[i].value = value;
-            return EMPTY();
-        }
+    // the value has to survive the statement
+    if (ip->persistent_allocator != NULL) {
+        value = ast_copy(ip->persistent_allocator, value);
     }
 
-    // variable does not exists
-    ip->variables[ip->variables_count].name = name;
-    ip->variables[ip->variables_count].value = value;
-    ip->variables_count += 1;
-
-    assert(ip->variables_count <= MAX_VARIABLES);
+    environment_set(interp_scope(ip), name, value);
+    // cached results may depend on the old value
+    memo_invalidate(&ip->memo);
 
     return EMPTY();
 }
 
 AST *interp_list(Interp *ip, AST *node) {
     // depth first
+    AST *list = LIST(node->list.nodes.size);
     for (usize i = 0; i < node->list.nodes.size; i++) {
-        node->list.nodes.data[i] = interp(ip, node->list.nodes.data[i]);
+        list_append(ip->allocator, list, interp(ip, node->list.nodes.data[i]));
     }
 
-    return node;
+    return list;
 }
 
-AST *interp(Interp *ip, AST *node) {
+void free_interp(Interp *ip) {
+    while (ip->scope != NULL) {
+        interp_pop_scope(ip);
+    }
+    free_environment(&ip->globals);
+    free_allocator(&ip->scratch);
+    free_cons_table(&ip->scratch_cons);
+    free_memo_cache(&ip->memo);
+}
+
+AST *interp_node(Interp *ip, AST *node) {
     switch (node->type) {
         case AST_PROGRAM:
             return interp_program(ip, node->program.statements);
         case AST_BINOP:
-            return interp_binop(ip, node->binop.left, node->binop.right, node->binop.op);
+            switch (node->binop.op) {
+                case OP_ADD:
+                case OP_SUB:
+                    return interp_terms(ip, node);
+                case OP_MUL:
+                    return interp_factors(ip, node);
+                default:
+                    return interp_binop(ip, node->binop.left, node->binop.right, node->binop.op);
+            }
         case AST_UNARYOP:
             return interp_unaryop(ip, node->unaryop.op, node->unaryop.operand);
         case AST_INTEGER:
+        case AST_BIGINT:
+        case AST_RATIONAL:
+        case AST_FACTORED:
             return node;
         case AST_SYMBOL:
-            return interp_symbol(ip, node->symbol.name);
+            return interp_symbol(ip, node);
         case AST_CONSTANT:
             return node;
         case AST_REAL: {
             f64 value = node->real.value;
             if (value - floor(value) == 0.0) {
-                return INTEGER((i64)value);
+                return interp_real(ip, value);
             }
             return node;
         }
         case AST_CALL:
-            return interp_call(ip, node->func_call.name, node->func_call.args);
+            return interp_call(ip, node->func_call.function, node->func_call.args);
         case AST_ASSIGN:
             return interp_assign(ip, node->assign.target, node->assign.value);
         case AST_LIST:
@@ -1073,3 +1873,20 @@ AST *interp(Interp *ip, AST *node) {
 
     todo();
 }
+
+AST *interp(Interp *ip, AST *node) {
+    if (!memo_cacheable(node)) {
+        return interp_node(ip, node);
+    }
+
+    AST *result = memo_get(&ip->memo, node);
+    if (result != NULL) {
+        ip->memo.hits += 1;
+        return result;
+    }
+
+    ip->memo.misses += 1;
+    result = interp_node(ip, node);
+    memo_put(&ip->memo, node, result);
+    return result;
+}
@@ -11,106 +11,86 @@ void lexer_print_tokens(Lexer *lexer) {
     Token token;
     do {
         token = lexer_next_token(lexer);
-        printf("%s('%s') ", token_type_to_string(token.type), token.text.str);
+        printf("%s('%.*s') ", token_type_to_string(token.type), (int)token.text.size, token.text.str);
     } while (token.type != TOKEN_EOF);
     printf("\n");
 }
 
 inline char lexer_current_char(Lexer *lexer) {
+    if (lexer->pos >= lexer->source.size) {
+        return '\0';
+    }
     return lexer->source.str[lexer->pos];
 }
 
+TokenType char_to_token_type(char c) {
+    switch (c) {
+        case '+': return TOKEN_PLUS;
+        case '-': return TOKEN_MINUS;
+        case '*': return TOKEN_STAR;
+        case '/': return TOKEN_SLASH;
+        case '^': return TOKEN_CARET;
+        case '%': return TOKEN_PCT;
+        case '=': return TOKEN_EQUAL;
+        case '(': return TOKEN_L_PAREN;
+        case ')': return TOKEN_R_PAREN;
+        case '[': return TOKEN_L_SQB;
+        case ']': return TOKEN_R_SQB;
+        case ',': return TOKEN_COMMA;
+        case '!': return TOKEN_EXCLAMATION_MARK;
+        default: return TOKEN_TYPE_COUNT;
+    }
+}
+
+// The text of a token is a view into the source of the lexer, so lexing doesn't
+// allocate at all. Keep in mind that the text is not null terminated.
 Token lexer_next_token(Lexer *lexer) {
     Token token = {0};
     assert(!token.contains_dot);
 
-    if (lexer->pos == lexer->source.size) {
+    // we dont use the isspace() function here because its although true for \n char
+    while (lexer_current_char(lexer) == ' ') {
+        lexer->pos += 1;
+    }
+
+    if (lexer->pos >= lexer->source.size) {
         token.type = TOKEN_EOF;
         return token;
     }
 
-    if (isdigit(lexer_current_char(lexer))) {
+    usize start = lexer->pos;
+    char c = lexer_current_char(lexer);
+
+    if (isdigit(c)) {
         // lex number
-        String buffer = init_string("");
+        u32 dots_count = 0;
         while (isdigit(lexer_current_char(lexer)) || lexer_current_char(lexer) == '.') {
-            char current_char = lexer_current_char(lexer);
-            buffer = string_concat(lexer->allocator, buffer, char_to_string(lexer->allocator, current_char));
+            if (lexer_current_char(lexer) == '.') {
+                dots_count += 1;
+            }
             lexer->pos += 1;
         }
         token.type = TOKEN_NUMBER;
+        token.text = string_view(lexer->source, start, lexer->pos);
+        token.contains_dot = dots_count > 0;
 
-        u32 dots_count = 0;
-        for (usize i = 0; i < buffer.size; i++) {
-            if (buffer.str[i] == '.') {
-                dots_count += 1;
-                token.contains_dot = true;
-            }
-        }
         assert(dots_count < 2);
-        assert(buffer.str[0] != '.');
-        assert(buffer.str[buffer.size-1] != '.');
+        assert(token.text.str[token.text.size-1] != '.');
 
-        token.text = buffer;
         return token;
-    } else if (isalpha(lexer_current_char(lexer))) {
+    } else if (isalpha(c)) {
         // lex identifier
-        String buffer = init_string("");
-        usize first = lexer->pos;
-        while (
-            isalpha(lexer_current_char(lexer)) ||
-            (lexer->pos > first && (isalpha(lexer_current_char(lexer)) ||
-            isdigit(lexer_current_char(lexer))))
-        ) {
-            char current_char = lexer_current_char(lexer);
-            buffer = string_concat(lexer->allocator, buffer, char_to_string(lexer->allocator, current_char));
+        while (isalpha(lexer_current_char(lexer)) || isdigit(lexer_current_char(lexer))) {
             lexer->pos += 1;
         }
 
         token.type = TOKEN_IDENTIFIER;
-        token.text = buffer;
-        return token;
-    } else if (lexer_current_char(lexer) == '+') {
-        token.type = TOKEN_PLUS;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == '-') {
-        token.type = TOKEN_MINUS;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == '*') {
-        token.type = TOKEN_STAR;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
+        token.text = string_view(lexer->source, start, lexer->pos);
+        token.symbol = intern(token.text);
         return token;
-    } else if (lexer_current_char(lexer) == '/') {
-        token.type = TOKEN_SLASH;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == '^') {
-        token.type = TOKEN_CARET;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == '(') {
-        token.type = TOKEN_L_PAREN;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == ')') {
-        token.type = TOKEN_R_PAREN;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == ' ') {
-        // we dont use the isspace() function here because its although true for \n char
-        lexer->pos += 1;
-        return lexer_next_token(lexer);
-    } else if (lexer_current_char(lexer) == '\n') {
+    } else if (c == '\n') {
         token.type = TOKEN_NEW_LINE;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
+        token.text = string_view(lexer->source, start, start+1);
         lexer->pos += 1;
 
         while (isspace(lexer_current_char(lexer))) {
@@ -122,51 +102,138 @@ Token lexer_next_token(Lexer *lexer) {
         }
 
         return token;
-    } else if (lexer_current_char(lexer) == ',') {
-        token.type = TOKEN_COMMA;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == '=') {
-        token.type = TOKEN_EQUAL;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == '!') {
-        token.type = TOKEN_EXCLAMATION_MARK;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == '%') {
-        token.type = TOKEN_PCT;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == '[') {
-        token.type = TOKEN_L_SQB;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else if (lexer_current_char(lexer) == ']') {
-        token.type = TOKEN_R_SQB;
-        token.text = char_to_string(lexer->allocator, lexer_current_char(lexer));
-        lexer->pos += 1;
-        return token;
-    } else {
-        fprintf(stderr, "ERROR: Can't tokenize '%c'\n", lexer_current_char(lexer));
-        exit(1);
     }
 
-    assert(false); // unreachable
-    token.type = TOKEN_EOF;
+    token.type = char_to_token_type(c);
+    if (token.type == TOKEN_TYPE_COUNT) {
+        fprintf(stderr, "ERROR: Can't tokenize '%c'\n", c);
+        exit(1);
+    }
+    token.text = string_view(lexer->source, start, start+1);
+    lexer->pos += 1;
     return token;
 }
 
-Token lexer_peek_token(Lexer *lexer) {
-    usize old_pos = lexer->pos;
-    Token token = lexer_next_token(lexer);
-    lexer->pos = old_pos;
-    return token;
+//
+// symbol table
+//
+
+#define SYMBOL_TABLE_MIN_CAPACITY 256
+
+typedef struct {
+    // symbols and their names live here until the end of the program
+    Allocator allocator;
+
+    // open addressing with linear probing, capacity is a power of 2
+    Symbol **slots;
+    usize capacity;
+    usize count;
+} SymbolTable;
+
+static SymbolTable symbol_table = {0};
+
+u64 string_hash(String s) {
+    // FNV-1a
+    u64 hash = 14695981039346656037ull;
+    for (usize i = 0; i < s.size; i++) {
+        hash ^= (u8)s.str[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void symbol_table_insert(Symbol *symbol) {
+    usize mask = symbol_table.capacity-1;
+    usize i = symbol->hash & mask;
+    while (symbol_table.slots[i] != NULL) {
+        i = (i+1) & mask;
+    }
+    symbol_table.slots[i] = symbol;
+    symbol_table.count += 1;
+}
+
+void symbol_table_grow() {
+    Symbol **old_slots = symbol_table.slots;
+    usize old_capacity = symbol_table.capacity;
+
+    symbol_table.capacity = old_capacity == 0 ? SYMBOL_TABLE_MIN_CAPACITY : old_capacity*2;
+    symbol_table.slots = calloc(symbol_table.capacity, sizeof(Symbol*));
+    assert(symbol_table.slots != NULL);
+    symbol_table.count = 0;
+
+    for (usize i = 0; i < old_capacity; i++) {
+        if (old_slots[i] != NULL) {
+            symbol_table_insert(old_slots[i]);
+        }
+    }
+    free(old_slots);
+}
+
+Symbol *symbol_table_add(String name, u64 hash) {
+    // keep the load factor below 1/2
+    if ((symbol_table.count+1)*2 > symbol_table.capacity) {
+        symbol_table_grow();
+    }
+
+    Symbol *symbol = alloc_type(&symbol_table.allocator, Symbol);
+    symbol->name.size = name.size;
+    symbol->name.str = alloc_array(&symbol_table.allocator, char, name.size+1);
+    memcpy(symbol->name.str, name.str, name.size);
+    symbol->name.str[name.size] = '\0';
+    symbol->hash = hash;
+    symbol->function = BUILTIN_NONE;
+    symbol->constant = CONSTANT_NONE;
+
+    symbol_table_insert(symbol);
+    return symbol;
+}
+
+Symbol *symbol_table_find(String name, u64 hash) {
+    if (symbol_table.capacity == 0) {
+        return NULL;
+    }
+
+    usize mask = symbol_table.capacity-1;
+    for (usize i = hash & mask; symbol_table.slots[i] != NULL; i = (i+1) & mask) {
+        Symbol *symbol = symbol_table.slots[i];
+        if (symbol->hash == hash && string_eq(symbol->name, name)) {
+            return symbol;
+        }
+    }
+    return NULL;
+}
+
+void symbol_table_init() {
+    // builtins are interned first and know their ids, so the parser and the
+    // interpreter never have to compare names to find them
+    for (BuiltinFunction function = BUILTIN_NONE+1; function < BUILTIN_FUNCTION_COUNT; function++) {
+        String name = init_string(builtin_function_to_string(function));
+        symbol_table_add(name, string_hash(name))->function = function;
+    }
+    for (BuiltinConstant constant = CONSTANT_NONE+1; constant < BUILTIN_CONSTANT_COUNT; constant++) {
+        String name = init_string(builtin_constant_to_string(constant));
+        symbol_table_add(name, string_hash(name))->constant = constant;
+    }
+}
+
+Symbol *intern(String name) {
+    if (symbol_table.capacity == 0) {
+        symbol_table_init();
+    }
+
+    u64 hash = string_hash(name);
+    Symbol *symbol = symbol_table_find(name, hash);
+    if (symbol == NULL) {
+        symbol = symbol_table_add(name, hash);
+    }
+    return symbol;
+}
+
+void free_symbol_table() {
+    free(symbol_table.slots);
+    free_allocator(&symbol_table.allocator);
+    SymbolTable empty = {0};
+    symbol_table = empty;
 }
 
 const char *token_type_to_string(TokenType type) {
@@ -3,6 +3,7 @@
 //       this if we implement new functions for strings.
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -12,7 +13,6 @@
 
 #include "casc.h"
 
-#define ARENA_SIZE 1024
 #define TEST_EARLY_STOP true
 
 Allocator init_allocator() {
@@ -20,59 +20,302 @@ Allocator init_allocator() {
     return a;
 }
 
-void *alloc(Allocator *allocator, usize size) {
-    // bring size up to a power of 2 to have proper alignment
-    usize padding = 64;
-    if (size % padding != 0) {
-        size = size+(padding-size%padding);
+// Chunks of freed or rewound allocators are kept here and handed out again to the next
+// allocator, so short lived allocators (every test, every evaluation in the gui) don't
+// hit malloc after warm-up. There is one pool per thread, so no locking is needed.
+typedef struct {
+    Arena *free_arenas[ARENA_SIZE_CLASSES];
+    usize size;
+} ArenaPool;
+
+static _Thread_local ArenaPool arena_pool = {0};
+
+i32 arena_size_class(usize size) {
+    // only the geometric chunk sizes are pooled, large arenas have arbitrary sizes
+    for (i32 i = 0; i < ARENA_SIZE_CLASSES; i++) {
+        if (size == (usize)ARENA_MIN_SIZE << i) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+Arena *arena_create(Allocator *allocator, usize size) {
+    Arena *arena = NULL;
+
+    i32 size_class = arena_size_class(size);
+    if (size_class >= 0 && arena_pool.free_arenas[size_class] != NULL) {
+        arena = arena_pool.free_arenas[size_class];
+        arena_pool.free_arenas[size_class] = arena->prev;
+        arena_pool.size -= size;
+
+        if (allocator->stats != NULL) {
+            allocator->stats->arenas_reused += 1;
+        }
+    } else {
+        // header and memory share one malloc, the memory starts right after the header
+        arena = malloc(sizeof(Arena) + size);
+        assert(arena != NULL);
+        arena->memory = (u8*)(arena + 1);
+        arena->size = size;
+
+        if (allocator->stats != NULL) {
+            allocator->stats->arenas_created += 1;
+        }
+    }
+
+    arena->prev = NULL;
+    arena->offset = 0;
+
+    AllocatorStats *stats = allocator->stats;
+    if (stats != NULL) {
+        stats->arenas_count += 1;
+        stats->reserved_bytes += size;
+        if (stats->reserved_bytes > stats->peak_reserved_bytes) {
+            stats->peak_reserved_bytes = stats->reserved_bytes;
+        }
     }
-    assert(size > 0);
-    assert(size % 32 == 0);
-    assert(size <= ARENA_SIZE);
 
-    // check if we have a arena
+    return arena;
+}
+
+void arena_destroy(Allocator *allocator, Arena *arena) {
+    AllocatorStats *stats = allocator->stats;
+    if (stats != NULL) {
+        stats->arenas_count -= 1;
+        stats->reserved_bytes -= arena->size;
+        stats->used_bytes -= arena->offset;
+    }
+
+    i32 size_class = arena_size_class(arena->size);
+    if (size_class >= 0 && arena_pool.size + arena->size <= ARENA_POOL_MAX_SIZE) {
+        arena->prev = arena_pool.free_arenas[size_class];
+        arena_pool.free_arenas[size_class] = arena;
+        arena_pool.size += arena->size;
+    } else {
+        free(arena);
+    }
+}
+
+void arena_pool_clear() {
+    for (i32 i = 0; i < ARENA_SIZE_CLASSES; i++) {
+        Arena *arena = arena_pool.free_arenas[i];
+        while (arena != NULL) {
+            Arena *prev_arena = arena->prev;
+            free(arena);
+            arena = prev_arena;
+        }
+        arena_pool.free_arenas[i] = NULL;
+    }
+    arena_pool.size = 0;
+}
+
+usize arena_pool_size() {
+    return arena_pool.size;
+}
+
+void allocator_stats_add(Allocator *allocator, usize size, usize padding) {
+    AllocatorStats *stats = allocator->stats;
+    stats->allocations += 1;
+    stats->requested_bytes += size;
+    stats->padding_bytes += padding;
+    stats->used_bytes += size + padding;
+    if (stats->used_bytes > stats->peak_used_bytes) {
+        stats->peak_used_bytes = stats->used_bytes;
+    }
+}
+
+usize align_forward(usize offset, usize align) {
+    assert(align > 0 && (align & (align-1)) == 0); // power of 2
+    return (offset + align-1) & ~(align-1);
+}
+
+void *alloc_large(Allocator *allocator, usize size, usize align) {
+    // Large blocks get their own arena which is linked in behind the current one. That
+    // way the free space left in the current arena can still be used by the next small
+    // allocations and we don't waste a half filled chunk for every big list or string.
     if (allocator->arena == NULL) {
-        // TODO: duplicate code here @1
-        allocator->arena = calloc(1, sizeof(Arena)); // to ensure zero initialization
-        allocator->arena->memory = malloc(ARENA_SIZE);
-        allocator->arena->size = ARENA_SIZE;
-        assert(allocator->arena->memory != NULL);
-    }
-
-    // compute free capacity of current arena
-    usize free_capacity = allocator->arena->size - allocator->arena->offset;
-
-    // choose arena
-    if (free_capacity < size) {
-        Arena *last_arena = allocator->arena;
-        // TODO: duplicate code here @1
-        allocator->arena = calloc(1, sizeof(Arena));
-        allocator->arena->memory = malloc(ARENA_SIZE);
-        allocator->arena->size = ARENA_SIZE;
-        allocator->arena->prev = last_arena; // difference @1
-        assert(allocator->arena->memory != NULL);
+        allocator->arena = arena_create(allocator, ARENA_MIN_SIZE);
+    }
+
+    Arena *arena = arena_create(allocator, size + align);
+    usize start = align_forward((usize)arena->memory, align) - (usize)arena->memory;
+    arena->offset = start + size;
+
+    arena->prev = allocator->arena->prev;
+    allocator->arena->prev = arena;
+
+    if (allocator->stats != NULL) {
+        allocator->stats->large_allocations += 1;
+        allocator_stats_add(allocator, size, start);
+    }
+
+    return arena->memory + start;
+}
+
+void *alloc_aligned(Allocator *allocator, usize size, usize align) {
+    assert(size > 0);
+
+    if (size > ARENA_LARGE_ALLOCATION) {
+        return alloc_large(allocator, size, align);
+    }
+
+    Arena *arena = allocator->arena;
+
+    // Work on absolute addresses here, because the memory of an arena is only
+    // guaranteed to be aligned like malloc memory.
+    usize start = 0;
+    if (arena != NULL) {
+        start = align_forward((usize)arena->memory + arena->offset, align) - (usize)arena->memory;
+    }
+
+    if (arena == NULL || start + size > arena->size) {
+        // chunks grow geometrically so a big workload needs only a few mallocs
+        usize arena_size = ARENA_MIN_SIZE;
+        if (arena != NULL && arena->size*2 <= ARENA_MAX_SIZE) {
+            arena_size = arena->size*2;
+        } else if (arena != NULL) {
+            arena_size = ARENA_MAX_SIZE;
+        }
+        // everything up to ARENA_LARGE_ALLOCATION has to fit, even after a small chunk
+        while (arena_size < size + align) {
+            arena_size *= 2;
+        }
+
+        Arena *new_arena = arena_create(allocator, arena_size);
+        new_arena->prev = arena;
+        allocator->arena = new_arena;
+        arena = new_arena;
+
+        start = align_forward((usize)arena->memory, align) - (usize)arena->memory;
+    }
+
+    if (allocator->stats != NULL) {
+        allocator_stats_add(allocator, size, start - arena->offset);
+    }
+
+    arena->offset = start + size;
+    return arena->memory + start;
+}
+
+void *alloc(Allocator *allocator, usize size) {
+    return alloc_aligned(allocator, size, ARENA_DEFAULT_ALIGNMENT);
+}
+
+void *alloc_resize(Allocator *allocator, void *memory, usize old_size, usize new_size, usize align) {
+    if (memory == NULL) {
+        return alloc_aligned(allocator, new_size, align);
+    }
+
+    // The last allocation of the current arena can simply grow (or shrink) in place.
+    // Everything else needs a new block and a copy, the old block is lost until the
+    // allocator gets freed.
+    Arena *arena = allocator->arena;
+    if (
+        arena != NULL &&
+        (u8*)memory + old_size == arena->memory + arena->offset &&
+        (u8*)memory + new_size <= arena->memory + arena->size
+    ) {
+        arena->offset = (u8*)memory + new_size - arena->memory;
+
+        AllocatorStats *stats = allocator->stats;
+        if (stats != NULL) {
+            stats->resized_in_place += 1;
+            stats->requested_bytes += new_size - old_size;
+            stats->used_bytes += new_size - old_size;
+            if (stats->used_bytes > stats->peak_used_bytes) {
+                stats->peak_used_bytes = stats->used_bytes;
+            }
+        }
+
+        return memory;
+    }
+
+    void *new_memory = alloc_aligned(allocator, new_size, align);
+    memcpy(new_memory, memory, old_size < new_size ? old_size : new_size);
+    return new_memory;
+}
+
+ArenaMark arena_mark(Allocator *allocator) {
+    ArenaMark mark = {0};
+    mark.arena = allocator->arena;
+    if (mark.arena != NULL) {
+        mark.offset = mark.arena->offset;
+        mark.prev = mark.arena->prev;
     }
+    if (allocator->cons != NULL) {
+        mark.cons_count = allocator->cons->count;
+    }
+    return mark;
+}
+
+void arena_rewind(Allocator *allocator, ArenaMark mark) {
+    // the consed nodes have to be removed while their memory is still valid
+    if (allocator->cons != NULL) {
+        cons_table_rewind(allocator->cons, mark.cons_count);
+    }
+
+    // free every arena that was created after the mark
     Arena *arena = allocator->arena;
+    while (arena != mark.arena) {
+        assert(arena != NULL); // mark does not belong to this allocator
+        Arena *prev_arena = arena->prev;
+        arena_destroy(allocator, arena);
+        arena = prev_arena;
+    }
 
-    // give memory
-    void *memory = arena->memory + arena->offset;
-    arena->offset += size;
-    return memory;
+    if (arena != NULL) {
+        // large arenas are linked in behind the current arena, so the marked
+        // arena can have new ones in front of its old predecessor
+        Arena *prev_arena = arena->prev;
+        while (prev_arena != mark.prev) {
+            assert(prev_arena != NULL);
+            Arena *next = prev_arena->prev;
+            arena_destroy(allocator, prev_arena);
+            prev_arena = next;
+        }
+        arena->prev = mark.prev;
+
+        if (allocator->stats != NULL) {
+            allocator->stats->used_bytes -= arena->offset - mark.offset;
+        }
+        arena->offset = mark.offset;
+    }
+
+    allocator->arena = arena;
 }
 
 void free_allocator(Allocator *allocator) {
+    if (allocator->cons != NULL) {
+        cons_table_rewind(allocator->cons, 0);
+    }
+
     Arena *arena = allocator->arena;
     while (arena != NULL) {
         Arena *prev_arena = arena->prev;
-        free(arena->memory);
-        free(arena);
-        if (prev_arena != NULL) {
-            arena = prev_arena;
-        } else {
-            // TODO: maybe we dont need this because free ensures that arena is NULL now
-            arena = NULL; 
+        arena_destroy(allocator, arena);
+        arena = prev_arena;
+    }
+    allocator->arena = NULL;
+}
+
+void print_allocator_stats(const char *name, AllocatorStats *stats) {
+    printf("%s:\n", name);
+    printf("  allocations:        %zu (%zu large, %zu resized in place)\n", stats->allocations, stats->large_allocations, stats->resized_in_place);
+    printf("  requested bytes:    %zu\n", stats->requested_bytes);
+    printf("  padding bytes:      %zu\n", stats->padding_bytes);
+    printf("  arenas:             %zu (%zu created, %zu reused from pool)\n", stats->arenas_count, stats->arenas_created, stats->arenas_reused);
+    printf("  used bytes:         %zu (peak %zu)\n", stats->used_bytes, stats->peak_used_bytes);
+    printf("  reserved bytes:     %zu (peak %zu)\n", stats->reserved_bytes, stats->peak_reserved_bytes);
+    printf("  nodes:\n");
+    for (ASTType type = 0; type < AST_TYPE_COUNT; type++) {
+        if (stats->nodes[type] > 0) {
+            printf("    %-16s  %zu\n", ast_type_to_debug_string(type), stats->nodes[type]);
         }
     }
+    if (stats->cons_hits > 0) {
+        printf("  hash-consed nodes:  %zu\n", stats->cons_hits);
+    }
 }
 
 String init_string(const char *str) {
@@ -85,7 +328,7 @@ String init_string(const char *str) {
 String char_to_string(Allocator *allocator, char c) {
     String s = {0};
     s.size = 1;
-    s.str = alloc(allocator, 2);
+    s.str = alloc_array(allocator, char, 2);
     s.str[0] = c;
     s.str[1] = '\0';
     return s;
@@ -94,7 +337,7 @@ String char_to_string(Allocator *allocator, char c) {
 String string_slice(Allocator *allocator, String s, usize start, usize stop) {
     String new_s = {0};
     new_s.size = stop-start;
-    new_s.str = alloc(allocator, new_s.size+1);
+    new_s.str = alloc_array(allocator, char, new_s.size+1);
     strncpy(new_s.str, &s.str[start], new_s.size);
     new_s.str[new_s.size] = '\0';
     return new_s;
@@ -103,7 +346,7 @@ String string_slice(Allocator *allocator, String s, usize start, usize stop) {
 String string_concat(Allocator *allocator, String s1, String s2) {
     String s = {0};
     s.size = s1.size+s2.size;
-    s.str = alloc(allocator, s.size+1);
+    s.str = alloc_array(allocator, char, s.size+1);
     strncpy(s.str, s1.str, s1.size);
     strncpy(&s.str[s1.size], s2.str, s2.size);
     s.str[s.size] = '\0';
@@ -119,6 +362,39 @@ String string_insert(Allocator *allocator, String s1, String s2, usize idx) {
     return new_s;
 }
 
+String string_view(String s, usize start, usize stop) {
+    // unlike string_slice this doesn't copy, so the result is not null terminated
+    assert(start <= stop && stop <= s.size);
+    String view = {0};
+    view.str = s.str + start;
+    view.size = stop-start;
+    return view;
+}
+
+i64 string_to_i64(String s) {
+    i64 value = 0;
+    for (usize i = 0; i < s.size; i++) {
+        assert(isdigit(s.str[i]));
+        value = value*10 + (s.str[i]-'0');
+    }
+    return value;
+}
+
+f64 string_to_f64(String s) {
+    // strtod needs a null terminated string and would read over the end of a view,
+    // literals are short so the copy only goes to the heap for unusual ones
+    char small[64];
+    char *buffer = s.size < sizeof(small) ? small : malloc(s.size + 1);
+    assert(buffer != NULL);
+    memcpy(buffer, s.str, s.size);
+    buffer[s.size] = '\0';
+    f64 value = strtod(buffer, NULL);
+    if (buffer != small) {
+        free(buffer);
+    }
+    return value;
+}
+
 bool string_eq(String s1, String s2) {
     if (s1.size != s2.size) {
         return false;
@@ -139,44 +415,91 @@ void print(String s) {
     printf("\n");
 }
 
+String string_format(Allocator *allocator, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    i32 size = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    assert(size >= 0);
+
+    String s = {0};
+    s.str = alloc_array(allocator, char, size+1);
+    s.size = size;
+    va_start(args, format);
+    vsnprintf(s.str, size+1, format, args);
+    va_end(args);
+    return s;
+}
+
+void string_append_format(Allocator *allocator, String *s, usize *capacity, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    i32 size = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    assert(size >= 0);
+
+    if (s->size + size + 1 > *capacity) {
+        usize new_capacity = *capacity == 0 ? 64 : *capacity*2;
+        while (s->size + size + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        s->str = resize_array(allocator, char, s->str, *capacity, new_capacity);
+        *capacity = new_capacity;
+    }
+
+    va_start(args, format);
+    vsnprintf(&s->str[s->size], size+1, format, args);
+    va_end(args);
+    s->size += size;
+}
+
 void _test_ast(u32 line_number, String source, String test_source) {
-    Allocator allocator = init_allocator();
+    // every case has to give the same result with and without hash-consing
+    for (i32 hash_consing = 0; hash_consing <= 1; hash_consing++) {
+        Allocator allocator = init_allocator();
+        ConsTable cons = {0};
+        if (hash_consing) {
+            allocator.cons = &cons;
+        }
 
-    Lexer lexer = {0};
-    lexer.source = source;
-    lexer.allocator = &allocator;
+        Lexer lexer = {0};
+        lexer.source = source;
+        lexer.allocator = &allocator;
 
-    Interp ip = {0};
-    ip.allocator = &allocator;
+        Interp ip = {0};
+        ip.allocator = &allocator;
 
-    AST* output = parse(&lexer);
-    output = interp(&ip, output);
+        AST* output = parse(&lexer);
+        output = interp(&ip, output);
+
+        printf("test:%d%s ... ", line_number, hash_consing ? " (hash-consing)" : "");
 
-    printf("test:%d ... ", line_number);
-
-    String output_string = ast_to_string(ip.allocator, output);
-    if (!string_eq(output_string, test_source)) {
-        printf("FAILED\n");
-        printf("\nPARAMETERS:\n");
-        printf("source:\n");
-        print(source);
-        printf("test_source:\n");
-        print(test_source);
-        printf("\nASSERTION:\n");
-        print(output_string);
-        printf("!=\n");
-        print(test_source);
-        printf("\n");
-        
+        String output_string = ast_to_string(ip.allocator, output);
+        if (!string_eq(output_string, test_source)) {
+            printf("FAILED\n");
+            printf("\nPARAMETERS:\n");
+            printf("source:\n");
+            print(source);
+            printf("test_source:\n");
+            print(test_source);
+            printf("\nASSERTION:\n");
+            print(output_string);
+            printf("!=\n");
+            print(test_source);
+            printf("\n");
+            
 #if TEST_EARLY_STOP
-        exit(1);
+            exit(1);
 #endif
 
-    } else { 
-        printf("OK\n");
-    }
+        } else { 
+            printf("OK\n");
+        }
 
-    free_allocator(&allocator);
+        free_interp(&ip);
+        free_allocator(&allocator);
+        free_cons_table(&cons);
+    }
 }
 
 void test() {
@@ -260,6 +583,11 @@ void test() {
     
     // misc
     test_ast("sqrt(9)", "3");
+    test_ast("sqrt(12)", "2*sqrt(3)");
+    test_ast("sqrt(1000000007)", "sqrt(1000000007)");
+    test_ast("sqrt(999999999989*999999999989)", "999999999989");
+    test_ast("sqrt(18446744030759878681*3)", "4294967291*sqrt(3)");
+    test_ast("sqrt(factorial(30))", "15692092416000*sqrt(1077205)");
     test_ast("1/3 * sin(pi) - cos(pi/2) / cos(pi) + 54/2 * sqrt(9)", "81");
     test_ast("3^2^3", "6561");
     test_ast("3^(2^3)", "6561");
@@ -294,11 +622,565 @@ void test() {
     test_ast("x = 4\n     3\n\n \n   \ny = 3\n\nx\n\n\n\n\n\n\nx*y+4\n\n\n   ", "16");
     test_ast("floor(3.4)", "3");
     test_ast("ceil(3.4)", "4");
+    // real literals of any length
+    test_ast("1.2500000000000000000000000000000000000000000000000000000000000000000000001 * 2", "2.500000");
     test_ast("12 % 5", "2");
     test_ast("v = [1, 2, 33]\nsum(v)", "36");
+    test_ast("0.5e2", "0.500000*e2");
+    test_ast("abc1 = 3\nabc1*2", "6");
+    test_ast("e = 5\npi = 3\ne", "e");
+    test_ast("sin(x)", "sin(x)");
+
+    // sums and products are collected n-ary and printed in canonical order
+    test_ast("a+b+a", "2*a+b");
+    test_ast("1 + x", "x+1");
+    test_ast("x - 3 + 5", "x+2");
+    test_ast("b-a-b", "-a");
+    test_ast("3*x - x*2 + y", "x+y");
+    test_ast("-(x+y) + x", "-y");
+    test_ast("2*x*3", "6*x");
+    test_ast("y*x*y", "x*y^2");
+    test_ast("x*x^2", "x^3");
+    test_ast("v = [x, 2, x]\nsum(v)", "2*x+2");
+    test_ast("v = [x, 2, x]\nprod(v)", "2*x^2");
+    test_ast("2-x", "2-x");
+    test_ast("1-x-y", "1-x-y");
+    test_ast("x^2-2*x+1", "x^2-2*x+1");
+    test_ast("x*(-1)", "-x");
+    test_ast("x^3 + x + x^2", "x^3+x^2+x");
+    test_ast("-1-x", "-x-1");
+
+    // cached results must not outlive a reassignment
+    test_ast("x = 2\nx*y\nx = 5\nx*y", "5*y");
+    test_ast("v = [1, 2]\nsum(v)\nv = [3, 4]\nsum(v)", "7");
+
+    // rule table
+    test_ast("-(-x)", "x");
+    test_ast("abs(-(x+1))", "abs(x+1)");
+    test_ast("x/1 + 1^y", "x+1");
+    test_ast("ln(e) + log(x, x)", "2");
+    test_ast("x^(2-1)", "x");
+    test_ast("simplify(sin(x))", "sin(x)");
+    // odd powers of negative numbers must not fold to 1
+    test_ast("simplify((y-x)^2)", "(y-x)^2");
+    test_ast("simplify(x*(-1)^3 + x)", "0");
+    // adding a negative literal is extracted as a subtraction
+    test_ast("simplify((3-x)*(0-z))", "(x-3)*z");
+    test_ast("simplify(x + -3)", "x-3");
+
+    // big integers
+    test_ast("factorial(20)", "2432902008176640000");
+    test_ast("factorial(21)", "51090942171709440000");
+    test_ast("factorial(40)", "815915283247897734345611269596115894272000000000");
+    test_ast("factorial(4294967296)", "factorial(4294967296)");
+    test_ast("ncr(40, 2)", "780");
+    test_ast("ncr(100, 50)", "100891344545564193334812497256");
+    test_ast("npr(30, 15)", "202843204931727360000");
+    test_ast("ncr(67, 33)", "14226520737620288370");
+    test_ast("ncr(1000000000, 2)", "499999999500000000");
+    test_ast("factorial(25) / factorial(23)", "600");
+    test_ast("99999999999999999999 * 99999999999999999999", "9999999999999999999800000000000000000001");
+    test_ast("123456789012345678901234567890 + 1 - 123456789012345678901234567890", "1");
+    test_ast("gcd(factorial(25), 100000000000000000000)", "16384000000");
+    test_ast("x + 100000000000000000000 - 200000000000000000000", "x-100000000000000000000");
+
+    // i64 overflow promotes to a big integer instead of wrapping
+    test_ast("9223372036854775807 + 1", "9223372036854775808");
+    test_ast("-9223372036854775807 - 2", "-9223372036854775809");
+    test_ast("3037000500*3037000500", "9223372037000250000");
+    test_ast("3^40", "12157665459056928801");
+    test_ast("2^-2", "1/4");
+    test_ast("(-9223372036854775807-1)/(-1)", "9223372036854775808");
+    test_ast("(-9223372036854775807-1)%(-1)", "0");
+    test_ast("7%0", "7%0");
+    test_ast("100000000000000000000%0", "100000000000000000000%0");
+    test_ast("100000000000000000000%7", "2");
+    test_ast("9007199254740993 + 0", "9007199254740993");
+    test_ast("lcm(9223372036854775807, 2)", "18446744073709551614");
+    test_ast("(-1)^100000000000000000001", "-1");
+
+    // rationals
+    test_ast("2/4", "1/2");
+    test_ast("6/-4", "-3/2");
+    test_ast("1/2+1/3", "5/6");
+    test_ast("1/2-1/2", "0");
+    test_ast("2/(1/3)", "6");
+    test_ast("(2/3)^-2", "9/4");
+    test_ast("(2/3)*(3/2)", "1");
+    test_ast("x - 1/2", "x-1/2");
+    test_ast("-(1/2)", "-1/2");
+    test_ast("-(-2/3)", "2/3");
+    test_ast("-(10000000000000000000001/3)", "-10000000000000000000001/3");
+    test_ast("abs(-2/3)", "2/3");
+    test_ast("abs(-10000000000000000000001/3)", "10000000000000000000001/3");
+    test_ast("1/9223372036854775807 + 1/9223372036854775806", "18446744073709551613/85070591730234615838173535747377725442");
+
+    // factorization and primes
+    test_ast("factor(12)", "2^2*3");
+    test_ast("factor(-360)", "-1*2^3*3^2*5");
+    test_ast("factor(1)", "1");
+    test_ast("factor(600851475143)", "71*839*1471*6857");
+    test_ast("factor(18446744073709551615)", "3*5*17*257*641*65537*6700417");
+    test_ast("factor(4611686014132420609)", "2147483647^2");
+    test_ast("factor(12)*2", "2*2^2*3");
+    test_ast("factor(12)+1", "2^2*3+1");
+    test_ast("factor(12)^2", "(2^2*3)^2");
+    test_ast("factor(12) - factor(12)", "0");
+    test_ast("factor(7)*x", "7*x");
+    test_ast("isprime(97)", "1");
+    test_ast("isprime(1)", "0");
+    test_ast("isprime(-7)", "0");
+    test_ast("isprime(18446744073709551557)", "1");
+    test_ast("nextprime(13)", "17");
+    test_ast("nextprime(-5)", "2");
+    test_ast("nextprime(1000000000000)", "1000000000039");
+    test_ast("nextprime(18446744073709551556)", "18446744073709551557");
 
     printf("\n\n");
 
+    {
+        // test allocator
+        Allocator allocator = init_allocator();
+
+        char *c = alloc_array(&allocator, char, 3);
+        f64 *d = alloc_type(&allocator, f64);
+        assert((usize)d % _Alignof(f64) == 0);
+        assert((u8*)d - (u8*)c < 16); // no flat padding anymore
+
+        // bigger than a chunk, the current chunk stays in use
+        u8 *large = alloc(&allocator, ARENA_MAX_SIZE*2);
+        memset(large, 1, ARENA_MAX_SIZE*2);
+        AST *node = alloc_type(&allocator, AST);
+        assert((u8*)node - (u8*)d < 64);
+
+        // everything after the mark is gone after rewinding, including new chunks
+        ArenaMark mark = arena_mark(&allocator);
+        for (usize i = 0; i < 1000; i++) {
+            alloc_type(&allocator, AST);
+        }
+        alloc(&allocator, ARENA_MAX_SIZE);
+        arena_rewind(&allocator, mark);
+        assert(allocator.arena == mark.arena);
+        assert(allocator.arena->prev == mark.prev);
+        assert(alloc_type(&allocator, AST) == node+1);
+
+        // the last allocation grows in place
+        ASTArray array = init_ast_array_with_capacity(&allocator, 1);
+        AST **data = array.data;
+        for (usize i = 0; i < 100; i++) {
+            ast_array_append(&allocator, &array, node);
+        }
+        assert(array.data == data);
+        assert(array.size == 100 && array.capacity >= 100);
+
+        // a block just below the large limit still fits into a new chunk
+        u8 *medium = alloc(&allocator, ARENA_LARGE_ALLOCATION);
+        memset(medium, 1, ARENA_LARGE_ALLOCATION);
+        assert(allocator.arena->size >= ARENA_LARGE_ALLOCATION);
+
+        free_allocator(&allocator);
+        assert(allocator.arena == NULL);
+
+        // statement results are copied out of the scratch arena and printed, long sums
+        // are too deep for a recursive walk
+        allocator = init_allocator();
+        Allocator copy_allocator = init_allocator();
+        AST *sum = init_ast_integer(&allocator, 0);
+        for (i64 i = 1; i <= 1 << 18; i++) {
+            sum = init_ast_binop(&allocator, sum, init_ast_integer(&allocator, i), OP_ADD);
+        }
+        AST *copy = ast_copy(&copy_allocator, sum);
+        assert(copy != sum && copy->hash == sum->hash);
+        String printed = ast_to_string(&copy_allocator, copy);
+        assert(printed.str[0] == '0' && printed.str[printed.size-1] == '4');
+        free_allocator(&copy_allocator);
+        free_allocator(&allocator);
+
+        // a new allocator gets its chunks from the pool
+        AllocatorStats stats = {0};
+        allocator.stats = &stats;
+        alloc_type(&allocator, AST);
+        assert(stats.arenas_created == 0 && stats.arenas_reused == 1);
+        free_allocator(&allocator);
+    }
+
+    {
+        // test symbols
+        char name[] = "sin";
+        Symbol *sin_symbol = intern(init_string(name));
+        assert(sin_symbol->function == BUILTIN_SIN);
+        assert(sin_symbol->name.str != name);
+        assert(intern(init_string("sin")) == sin_symbol);
+        assert(intern(init_string("pi"))->constant == CONSTANT_PI);
+
+        Symbol *x = intern(string_view(init_string("x+y"), 0, 1));
+        assert(x->function == BUILTIN_NONE && x->constant == CONSTANT_NONE);
+        assert(x == intern(init_string("x")));
+        assert(x != intern(init_string("y")));
+    }
+
+    {
+        // test variable environment
+        Allocator allocator = init_allocator();
+        Interp ip = {0};
+        ip.allocator = &allocator;
+
+        // more bindings than the old fixed array could hold
+        char name[32];
+        for (i64 i = 0; i < 5000; i++) {
+            snprintf(name, sizeof(name), "v%lld", (long long)i);
+            environment_set(&ip.globals, intern(init_string(name))->name, init_ast_integer(&allocator, i));
+        }
+        assert(ip.globals.count == 5000);
+        for (i64 i = 0; i < 5000; i++) {
+            snprintf(name, sizeof(name), "v%lld", (long long)i);
+            AST *value = environment_get(&ip.globals, intern(init_string(name))->name);
+            assert(value != NULL && value->integer.value == i);
+        }
+
+        // inner scopes shadow outer ones and vanish when popped
+        String x = intern(init_string("x"))->name;
+        String y = intern(init_string("y"))->name;
+        environment_set(&ip.globals, x, init_ast_integer(&allocator, 1));
+        interp_push_scope(&ip);
+        assert(environment_get(ip.scope, x)->integer.value == 1);
+        environment_set(ip.scope, x, init_ast_integer(&allocator, 2));
+        environment_set(ip.scope, y, init_ast_integer(&allocator, 3));
+        assert(environment_get(ip.scope, x)->integer.value == 2);
+        interp_pop_scope(&ip);
+        assert(ip.scope == NULL);
+        assert(environment_get(&ip.globals, x)->integer.value == 1);
+        assert(environment_get(&ip.globals, y) == NULL);
+
+        free_interp(&ip);
+        free_allocator(&allocator);
+    }
+
+    {
+        // test hash-consing
+        Allocator allocator = init_allocator();
+        ConsTable cons = {0};
+        allocator.cons = &cons;
+
+        String x = intern(init_string("x"))->name;
+        AST *a = init_ast_binop(&allocator, init_ast_symbol(&allocator, x), init_ast_integer(&allocator, 2000), OP_POW);
+        AST *b = init_ast_binop(&allocator, init_ast_symbol(&allocator, x), init_ast_integer(&allocator, 2000), OP_POW);
+        AST *c = init_ast_binop(&allocator, init_ast_symbol(&allocator, x), init_ast_integer(&allocator, 2000), OP_MUL);
+        assert(a == b && a != c);
+        assert(a->hash != c->hash && !ast_match(a, c));
+        assert(cons.count == 4);
+
+        // nodes of a rewound allocator leave the table
+        ArenaMark mark = arena_mark(&allocator);
+        AST *d = init_ast_binop(&allocator, a, init_ast_integer(&allocator, 3000), OP_ADD);
+        assert(cons.count == 6);
+        arena_rewind(&allocator, mark);
+        assert(cons.count == 4);
+        assert(init_ast_integer(&allocator, 2000) == a->binop.right);
+        d = init_ast_binop(&allocator, a, init_ast_integer(&allocator, 3000), OP_ADD);
+        assert(cons.count == 6);
+
+        // without a table equal trees are different nodes but still match
+        Allocator plain = init_allocator();
+        AST *e = init_ast_binop(&plain, a, init_ast_integer(&plain, 3000), OP_ADD);
+        assert(e != d && e->hash == d->hash && ast_match(e, d));
+        free_allocator(&plain);
+
+        free_allocator(&allocator);
+        assert(cons.count == 0);
+        free_cons_table(&cons);
+    }
+
+    {
+        // test static nodes and patterns
+        assert(ast_zero.hash == ast_hash(&ast_zero));
+        assert(ast_minus_one.hash == ast_hash(&ast_minus_one));
+        assert(ast_pi.hash == ast_hash(&ast_pi));
+
+        Allocator allocator = init_allocator();
+        AllocatorStats stats = {0};
+        allocator.stats = &stats;
+
+        AST *x = init_ast_symbol(&allocator, intern(init_string("x"))->name);
+        AST *x_squared_times_x = init_ast_binop(&allocator, init_ast_binop(&allocator, x, &ast_two, OP_POW), x, OP_MUL);
+        AST *y = init_ast_symbol(&allocator, intern(init_string("y"))->name);
+        AST *x_squared_times_y = init_ast_binop(&allocator, x_squared_times_x->binop.left, y, OP_MUL);
+        usize allocations = stats.allocations;
+
+        AST *bindings[PATTERN_MAX_SLOTS] = {0};
+        Pattern *pattern = MATCH_BINOP(OP_MUL, MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_ANY_INTEGER(2)), MATCH_ANY(1));
+        assert(pattern_match(pattern, x_squared_times_x, bindings));
+        assert(bindings[1] == x && bindings[2] == &ast_two);
+
+        // the same slot has to bind equal nodes
+        memset(bindings, 0, sizeof(bindings));
+        assert(!pattern_match(pattern, x_squared_times_y, bindings));
+        assert(!pattern_match(MATCH_INTEGER(1), &ast_minus_one, NULL));
+        assert(pattern_match(MATCH_CONSTANT(CONSTANT_PI), &ast_pi, NULL));
+        assert(stats.allocations == allocations);
+
+        free_allocator(&allocator);
+    }
+
+    {
+        // test memo cache
+        Allocator allocator = init_allocator();
+
+        Lexer lexer = {0};
+        lexer.source = init_string("sin(y)^2 + sin(y)^2\ncos(y) + sin(y)^2");
+        lexer.allocator = &allocator;
+
+        Interp ip = {0};
+        ip.allocator = &allocator;
+
+        AST *output = interp(&ip, parse(&lexer));
+        assert(string_eq(ast_to_string(&allocator, output), init_string("sin(y)^2+cos(y)")));
+        assert(ip.memo.hits == 2); // once in each statement
+        assert(ip.memo.count > 0);
+
+        AST *y = init_ast_symbol(&allocator, intern(init_string("y"))->name);
+        interp(&ip, init_ast_assign(&allocator, y, init_ast_integer(&allocator, 0)));
+        assert(ip.memo.count == 0 && ip.memo.stale);
+
+        free_interp(&ip);
+        free_allocator(&allocator);
+    }
+
+    {
+        // test rewrite
+        Allocator allocator = init_allocator();
+
+        Lexer lexer = {0};
+        lexer.source = init_string("abs(-(-(x^1)))");
+        lexer.allocator = &allocator;
+        AST *statement = parse(&lexer)->program.statements.data[0];
+
+        Interp ip = {0};
+        ip.allocator = &allocator;
+
+        // the replacement abs(-(x^1)) is rewritten on the worklist until no rule applies,
+        // abs(-x) fires again and x^1 becomes x
+        AST *output = rewrite_node(&ip, statement);
+        assert(string_eq(ast_to_string(&allocator, output), init_string("abs(x)")));
+        assert(rewrite_node(&ip, output) == NULL); // fixpoint
+
+        AST *x = statement->func_call.args.data[0]->unaryop.operand->unaryop.operand->binop.left;
+        AST node = { .type = AST_BINOP, .binop = { x, &ast_one, OP_POW } };
+        assert(rewrite_node(&ip, &node) == x);
+        node.binop.right = x;
+        assert(rewrite_node(&ip, &node) == NULL);
+
+        // the index only finds the shape, a slot used twice still has to bind equal nodes
+        AST *y = init_ast_symbol(&allocator, intern(init_string("y"))->name);
+        ASTArray args = {0};
+        ast_array_append(&allocator, &args, x);
+        ast_array_append(&allocator, &args, y);
+        AST call = { .type = AST_CALL, .func_call = { BUILTIN_LOG, args } };
+        assert(rewrite_node(&ip, &call) == NULL);
+        call.func_call.args.data[1] = x;
+        assert(pattern_match(MATCH_INTEGER(1), rewrite_node(&ip, &call), NULL));
+        call.func_call.args.data[0] = &ast_one;
+        assert(pattern_match(MATCH_INTEGER(0), rewrite_node(&ip, &call), NULL)); // log(1, b) comes first
+        call.func_call.args.size = 1;
+        assert(rewrite_node(&ip, &call) == NULL); // wrong number of args
+
+        free_interp(&ip);
+        free_allocator(&allocator);
+    }
+
+    {
+        // test egraph
+        Allocator allocator = init_allocator();
+
+        Lexer lexer = {0};
+        lexer.source = init_string("x*2 + x\n(x+1)*2 - 2\nx - y");
+        lexer.allocator = &allocator;
+        ASTArray statements = parse(&lexer)->program.statements;
+
+        Interp ip = {0};
+        ip.allocator = &allocator;
+
+        EGraphStats stats = {0};
+        EGraphBudget budget = { .max_iterations = 16, .max_nodes = 5000 };
+        AST *output = egraph_simplify(&ip, statements.data[0], budget, &stats);
+        assert(string_eq(ast_to_string(&allocator, output), init_string("3*x")));
+        assert(stats.saturated && stats.iterations < budget.max_iterations);
+
+        output = egraph_simplify(&ip, statements.data[1], budget, &stats);
+        assert(string_eq(ast_to_string(&allocator, output), init_string("x*2")));
+        assert(!stats.saturated && stats.nodes < budget.max_nodes + 16);
+
+        // nothing smaller, the input is kept as it is
+        assert(egraph_simplify(&ip, statements.data[2], budget, &stats) == statements.data[2]);
+
+        budget.max_iterations = 0;
+        assert(egraph_simplify(&ip, statements.data[0], budget, &stats) == statements.data[0]);
+        assert(stats.iterations == 0 && stats.nodes == 4); // x is shared
+
+        free_interp(&ip);
+        free_allocator(&allocator);
+    }
+
+    {
+        // test small integers
+        Allocator allocator = init_allocator();
+        AllocatorStats stats = {0};
+        allocator.stats = &stats;
+        Allocator other = init_allocator();
+
+        AST *n = init_ast_integer(&allocator, -7);
+        assert(n == init_ast_integer(&other, -7));
+        assert(n->integer.value == -7 && n->hash == ast_hash(n));
+        for (i64 i = SMALL_INTEGER_MIN; i <= SMALL_INTEGER_MAX; i++) {
+            AST *small = init_ast_integer(&allocator, i);
+            assert(small->type == AST_INTEGER && small->integer.value == i && small->hash == ast_hash(small));
+        }
+        assert(stats.allocations == 0);
+        assert(init_ast_integer(&allocator, SMALL_INTEGER_MAX+1) != init_ast_integer(&allocator, SMALL_INTEGER_MAX+1));
+        assert(stats.allocations == 2);
+
+        free_allocator(&other);
+        free_allocator(&allocator);
+    }
+
+    {
+        // test bignum
+        Allocator allocator = init_allocator();
+
+        Bignum three = bignum_from_i64(&allocator, 3);
+        Bignum seven = bignum_from_i64(&allocator, 7);
+        Bignum prime = bignum_from_i64(&allocator, 1000000007);
+
+        // sizes for schoolbook, Karatsuba and Toom-3, checked against python
+        Bignum remainder;
+        Bignum small = bignum_mul(&allocator, bignum_pow(&allocator, three, 300), bignum_pow(&allocator, seven, 200));
+        Bignum medium = bignum_mul(&allocator, bignum_pow(&allocator, three, 3000), bignum_pow(&allocator, seven, 2000));
+        Bignum large = bignum_mul(&allocator, bignum_pow(&allocator, three, 6000), bignum_pow(&allocator, seven, 4000));
+        bignum_divmod(&allocator, medium, prime, NULL, &remainder);
+        assert(bignum_compare(remainder, bignum_from_i64(&allocator, 897752066)) == 0);
+        bignum_divmod(&allocator, large, prime, NULL, &remainder);
+        assert(bignum_compare(remainder, bignum_from_i64(&allocator, 365556994)) == 0);
+        bignum_divmod(&allocator, bignum_range_product(&allocator, 1, 5000), prime, NULL, &remainder);
+        assert(bignum_compare(remainder, bignum_from_i64(&allocator, 541108809)) == 0);
+        assert(bignum_to_string(&allocator, medium).size == 3122);
+
+        // the prime swing factorial against the plain product
+        for (u64 n = 0; n <= 300; n++) {
+            assert(bignum_compare(bignum_factorial(&allocator, n), bignum_range_product(&allocator, 1, n)) == 0);
+        }
+        assert(bignum_compare(bignum_factorial(&allocator, 5000), bignum_range_product(&allocator, 1, 5000)) == 0);
+
+        // binomials from the Pascal table, the machine word loop and the prime product
+        // against n!/(k!(n-k)!), and Pascal's rule across the boundaries
+        u64 sizes[] = { 10, 67, 68, 100, 1000 };
+        for (usize i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+            u64 n = sizes[i];
+            for (u64 k = 0; k <= n; k += n < 100 ? 1 : 37) {
+                Bignum expected;
+                Bignum denominator = bignum_mul(&allocator, bignum_factorial(&allocator, k), bignum_factorial(&allocator, n-k));
+                bignum_divmod(&allocator, bignum_factorial(&allocator, n), denominator, &expected, NULL);
+                assert(bignum_compare(bignum_binomial(&allocator, n, k), expected) == 0);
+                if (k > 0 && k < n) {
+                    Bignum sum = bignum_add(&allocator, bignum_binomial(&allocator, n-1, k-1), bignum_binomial(&allocator, n-1, k));
+                    assert(bignum_compare(bignum_binomial(&allocator, n, k), sum) == 0);
+                }
+            }
+        }
+        assert(bignum_compare(bignum_permutations(&allocator, 30, 15), bignum_range_product(&allocator, 16, 30)) == 0);
+
+        // (a*b + c) / b = a remainder c, with a multi-limb divisor
+        Bignum quotient;
+        bignum_divmod(&allocator, bignum_add(&allocator, bignum_mul(&allocator, large, medium), small), medium, &quotient, &remainder);
+        assert(bignum_compare(quotient, large) == 0 && bignum_compare(remainder, small) == 0);
+        bignum_divmod(&allocator, bignum_negate(small), seven, &quotient, &remainder);
+        assert(remainder.size == 0 && quotient.negative);
+
+        // gcd(3^300*7^200, 3^3000*7^2000) = 3^300*7^200
+        assert(bignum_compare(bignum_gcd(&allocator, bignum_negate(medium), small), small) == 0);
+
+        // decimal round trip and the i64 limits
+        String digits = bignum_to_string(&allocator, large);
+        assert(bignum_compare(bignum_from_string(&allocator, digits), large) == 0);
+        i64 value;
+        assert(bignum_to_i64(bignum_from_i64(&allocator, INT64_MIN), &value) && value == INT64_MIN);
+        assert(!bignum_to_i64(bignum_add(&allocator, bignum_from_i64(&allocator, INT64_MAX), bignum_from_i64(&allocator, 1)), &value));
+        assert(init_ast_bigint(&allocator, bignum_from_i64(&allocator, -5))->type == AST_INTEGER);
+        assert(bignum_to_f64(bignum_from_f64(&allocator, 1e30)) == 1e30);
+
+        free_allocator(&allocator);
+    }
+
+    {
+        // test primes
+        Allocator allocator = init_allocator();
+
+        // isqrt around the points where the double is off
+        u64 roots[] = { 0, 1, 2, 3, 94906265, 3037000499, 3037000500, 4294967295 };
+        for (usize i = 0; i < sizeof(roots)/sizeof(roots[0]); i++) {
+            u64 r = roots[i];
+            assert(u64_isqrt(r*r) == r);
+            if (r > 0) {
+                assert(u64_isqrt(r*r - 1) == r-1);
+            }
+        }
+        assert(u64_isqrt(UINT64_MAX) == 4294967295);
+
+        // Miller-Rabin against the sieve
+        usize count;
+        const u32 *primes = small_primes(&count);
+        for (u64 n = 0, i = 0; n < SMALL_PRIMES_LIMIT; n++) {
+            bool is_prime = n == 2 || (i < count && primes[i] == n);
+            assert(u64_is_prime(n) == is_prime);
+            i += i < count && primes[i] == n;
+        }
+        assert(u64_is_prime(18446744073709551557ull) && !u64_is_prime(3215031751ull));
+
+        // random numbers and semiprimes of two 32 bit primes are the product of their factors
+        u64 state = 1;
+        for (usize i = 0; i < 2000; i++) {
+            state = state*6364136223846793005ull + 1442695040888963407ull;
+            u64 n = i % 2 == 0 ? state | 1 : 4294967291ull*(4294967197ull - 2*(i % 7)*(i % 3));
+            Factorization factorization = u64_factor(n);
+            u64 product = 1;
+            for (usize j = 0; j < factorization.count; j++) {
+                assert(u64_is_prime(factorization.primes[j]));
+                assert(j == 0 || factorization.primes[j-1] < factorization.primes[j]);
+                for (u32 e = 0; e < factorization.exponents[j]; e++) {
+                    product *= factorization.primes[j];
+                }
+            }
+            assert(product == n);
+        }
+
+        // cached factorizations are the same as fresh ones
+        Factorization first = u64_factor(4294967291ull*4294967279ull);
+        Factorization second = u64_factor(4294967291ull*4294967279ull);
+        assert(first.count == 2 && second.count == 2);
+        assert(memcmp(first.primes, second.primes, sizeof(first.primes)) == 0);
+        assert(memcmp(first.exponents, second.exponents, sizeof(first.exponents)) == 0);
+
+        u64 prime;
+        assert(u64_next_prime(1, &prime) && prime == 2);
+        assert(u64_next_prime(2, &prime) && prime == 3);
+        assert(u64_next_prime(4294967279ull, &prime) && prime == 4294967291ull);
+        assert(!u64_next_prime(U64_MAX_PRIME, &prime));
+
+        // 2^10 * 3^5 * 7 * 65537^2
+        u64 outside, inside;
+        u64_square_free(1024ull*243*7*65537*65537, &outside, &inside);
+        assert(outside == 32ull*9*65537 && inside == 21);
+
+        // a big square times a big prime outside of the sieve, n = outside^2 * inside
+        Bignum big_prime = bignum_from_u64(&allocator, 18446744073709551557ull);
+        Bignum n = bignum_mul(&allocator, bignum_factorial(&allocator, 200), bignum_pow(&allocator, big_prime, 3));
+        Bignum big_outside, big_inside;
+        bignum_square_free(&allocator, n, &big_outside, &big_inside);
+        assert(bignum_compare(bignum_mul(&allocator, bignum_mul(&allocator, big_outside, big_outside), big_inside), n) == 0);
+        assert(bignum_compare(bignum_isqrt(&allocator, bignum_mul(&allocator, n, n)), n) == 0);
+
+        free_allocator(&allocator);
+    }
+
     {
         // test strings
         Allocator allocator = init_allocator();
@@ -325,8 +1207,15 @@ void test() {
     printf("TESTS DONE!\n");
 }
 
-void main_cli() {
+void main_cli(bool show_stats, bool hash_consing) {
+    AllocatorStats stats = {0};
+    AllocatorStats scratch_stats = {0};
+    ConsTable cons = {0};
+
     Allocator allocator = init_allocator();
+    if (hash_consing) {
+        allocator.cons = &cons;
+    }
 
     Lexer lexer = {0};
     lexer.source = init_string("5 - - - + - (3 + 4) - +2");
@@ -337,6 +1226,11 @@ void main_cli() {
     Interp ip = {0};
     ip.allocator = &allocator;
 
+    if (show_stats) {
+        allocator.stats = &stats;
+        ip.scratch.stats = &scratch_stats;
+    }
+
     AST* output = parse(&lexer);
     printf("parsed:\n");
     print(ast_to_debug_string(&allocator, output));
@@ -347,17 +1241,36 @@ void main_cli() {
     print(ast_to_debug_string(&allocator, output));
     print(ast_to_string(&allocator, output));
 
+    if (show_stats) {
+        printf("stats:\n");
+        print_allocator_stats("allocator", &stats);
+        print_allocator_stats("scratch allocator", &scratch_stats);
+        printf("memo cache: %zu hits, %zu misses, %zu entries\n", ip.memo.hits, ip.memo.misses, ip.memo.count);
+    }
+
+    free_interp(&ip);
     free_allocator(&allocator);
+    free_cons_table(&cons);
+
+    if (show_stats) {
+        printf("arena pool: %zu bytes\n", arena_pool_size());
+    }
 }
 
 i32 main(i32 argc, char *argv[]) {
     bool do_test = false;
     bool do_cli = true;
     bool do_gui = false;
+    bool do_stats = false;
+    bool do_hash_consing = false;
 
     for (i32 i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--test")) {
             do_test = true;
+        } else if (!strcmp(argv[i], "--stats")) {
+            do_stats = true;
+        } else if (!strcmp(argv[i], "--hash-consing")) {
+            do_hash_consing = true;
         } else if (!strcmp(argv[i], "--gui")) {
             do_gui = true;
             do_cli = false;
@@ -373,7 +1286,7 @@ i32 main(i32 argc, char *argv[]) {
     }
 
     if (do_cli) {
-        main_cli();
+        main_cli(do_stats, do_hash_consing);
     } else if (do_gui) {
         init_gui();
     } else {
@@ -381,5 +1294,8 @@ i32 main(i32 argc, char *argv[]) {
         // unreachable
     }
 
+    free_symbol_table();
+    arena_pool_clear();
+
     return 0;
 }
\ No newline at end of file
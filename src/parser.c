@@ -6,89 +6,135 @@
 
 #include "casc.h"
 
-void parser_eat(Lexer *lexer, TokenType type) {
-    if (lexer_peek_token(lexer).type == type) {
-        lexer_next_token(lexer);
+void parser_tokenize(Parser *parser, Lexer *lexer) {
+    // Lex the whole source once up front, so looking ahead is just an index
+    // into the token array instead of lexing the same token over and over.
+    usize capacity = 64;
+    parser->tokens = malloc(capacity*sizeof(Token));
+    parser->tokens_count = 0;
+
+    Token token;
+    do {
+        token = lexer_next_token(lexer);
+        if (parser->tokens_count == capacity) {
+            capacity *= 2;
+            parser->tokens = realloc(parser->tokens, capacity*sizeof(Token));
+        }
+        assert(parser->tokens != NULL);
+        parser->tokens[parser->tokens_count++] = token;
+    } while (token.type != TOKEN_EOF);
+}
+
+Token parser_peek(Parser *parser, usize k) {
+    usize i = parser->pos + k;
+    if (i >= parser->tokens_count) {
+        // the last token is always EOF
+        i = parser->tokens_count-1;
+    }
+    return parser->tokens[i];
+}
+
+TokenType parser_peek_type(Parser *parser) {
+    return parser_peek(parser, 0).type;
+}
+
+Token parser_advance(Parser *parser) {
+    Token token = parser_peek(parser, 0);
+    if (parser->pos < parser->tokens_count-1) {
+        parser->pos += 1;
+    }
+    return token;
+}
+
+void parser_eat(Parser *parser, TokenType type) {
+    if (parser_peek_type(parser) == type) {
+        parser_advance(parser);
     } else {
-        fprintf(stderr, "ERROR: Expected %s got %s.\n", token_type_to_string(type), token_type_to_string(lexer_peek_token(lexer).type));
+        fprintf(stderr, "ERROR: Expected %s got %s.\n", token_type_to_string(type), token_type_to_string(parser_peek_type(parser)));
         assert(false);
     }
 }
 
-AST *parse_exp(Lexer *lexer) {
-    Token token = lexer_peek_token(lexer);
+AST *parse_exp(Parser *parser) {
+    Token token = parser_peek(parser, 0);
 
     AST *result = NULL;
 
     switch (token.type) {
 
         case TOKEN_NUMBER: {
-            parser_eat(lexer, TOKEN_NUMBER);
+            parser_eat(parser, TOKEN_NUMBER);
             if (token.contains_dot) {
-                result = init_ast_real(lexer->allocator, strtod(token.text.str, NULL));
+                result = init_ast_real(parser->allocator, string_to_f64(token.text));
+            } else if (token.text.size > 18) {
+                // might not fit into an i64, init_ast_bigint picks the right type
+                result = init_ast_bigint(parser->allocator, bignum_from_string(parser->allocator, token.text));
             } else {
-                result = init_ast_integer(lexer->allocator, atoi(token.text.str));
+                result = init_ast_integer(parser->allocator, string_to_i64(token.text));
             }
             break;
         }
 
         case TOKEN_IDENTIFIER: {
-            if (is_builtin_function(token.text)) {
-                parser_eat(lexer, TOKEN_IDENTIFIER);
-                parser_eat(lexer, TOKEN_L_PAREN);
+            Symbol *symbol = token.symbol;
+            parser_eat(parser, TOKEN_IDENTIFIER);
+
+            if (symbol->function != BUILTIN_NONE) {
+                parser_eat(parser, TOKEN_L_PAREN);
 
                 ASTArray args = {0};
-                ast_array_append(lexer->allocator, &args, parse_expr(lexer));
-                while (lexer_peek_token(lexer).type == TOKEN_COMMA) {
-                    parser_eat(lexer, TOKEN_COMMA);
-                    ast_array_append(lexer->allocator, &args, parse_expr(lexer));
+                ast_array_append(parser->allocator, &args, parse_expr(parser));
+                while (parser_peek_type(parser) == TOKEN_COMMA) {
+                    parser_eat(parser, TOKEN_COMMA);
+                    ast_array_append(parser->allocator, &args, parse_expr(parser));
                 }
 
-                parser_eat(lexer, TOKEN_R_PAREN);
-                result = init_ast_call(lexer->allocator, token.text, args);
+                parser_eat(parser, TOKEN_R_PAREN);
+                result = init_ast_call(parser->allocator, symbol->function, args);
+            } else if (symbol->constant != CONSTANT_NONE) {
+                result = init_ast_constant(parser->allocator, symbol->constant);
             } else {
-                parser_eat(lexer, TOKEN_IDENTIFIER);
-                result = init_ast_symbol(lexer->allocator, token.text);
+                result = init_ast_symbol(parser->allocator, symbol->name);
             }
             break;
         }
 
         case TOKEN_L_PAREN: {
-            parser_eat(lexer, TOKEN_L_PAREN);
-            result = parse_expr(lexer);
-            parser_eat(lexer, TOKEN_R_PAREN);
+            parser_eat(parser, TOKEN_L_PAREN);
+            result = parse_expr(parser);
+            parser_eat(parser, TOKEN_R_PAREN);
             break;
         }
 
         case TOKEN_L_SQB: {
-            parser_eat(lexer, TOKEN_L_SQB);
+            parser_eat(parser, TOKEN_L_SQB);
 
-            result = init_ast_list(lexer->allocator, DEFAULT_LIST_CAPACITY);
-            list_append(lexer->allocator, result, parse_expr(lexer));
-            while (lexer_peek_token(lexer).type == TOKEN_COMMA) {
-                parser_eat(lexer, TOKEN_COMMA);
-                list_append(lexer->allocator, result, parse_expr(lexer));
+            result = init_ast_list(parser->allocator, DEFAULT_LIST_CAPACITY);
+            list_append(parser->allocator, result, parse_expr(parser));
+            while (parser_peek_type(parser) == TOKEN_COMMA) {
+                parser_eat(parser, TOKEN_COMMA);
+                list_append(parser->allocator, result, parse_expr(parser));
             }
 
-            parser_eat(lexer, TOKEN_R_SQB);
+            parser_eat(parser, TOKEN_R_SQB);
             return result;
         }
 
         case TOKEN_MINUS: {
-            parser_eat(lexer, TOKEN_MINUS);
-            result = init_ast_unaryop(lexer->allocator, parse_factor(lexer), OP_USUB);
+            parser_eat(parser, TOKEN_MINUS);
+            result = init_ast_unaryop(parser->allocator, parse_factor(parser), OP_USUB);
             break;
         }
 
         case TOKEN_PLUS: {
-            parser_eat(lexer, TOKEN_PLUS);
-            result = init_ast_unaryop(lexer->allocator, parse_factor(lexer), OP_UADD);
+            parser_eat(parser, TOKEN_PLUS);
+            result = init_ast_unaryop(parser->allocator, parse_factor(parser), OP_UADD);
             break;
         }
 
         case TOKEN_EOF: {
             // I think we can ignore EOF token for now and simply return it
-            result = init_ast_empty(lexer->allocator);
+            result = init_ast_empty(parser->allocator);
             break;
         }
 
@@ -102,60 +148,60 @@ AST *parse_exp(Lexer *lexer) {
     assert(result != NULL);
 
     // !
-    if (lexer_peek_token(lexer).type == TOKEN_EXCLAMATION_MARK) {
-        parser_eat(lexer, TOKEN_EXCLAMATION_MARK);
+    if (parser_peek_type(parser) == TOKEN_EXCLAMATION_MARK) {
+        parser_eat(parser, TOKEN_EXCLAMATION_MARK);
 
         ASTArray args = {0};
-        ast_array_append(lexer->allocator, &args, result);
-        result = init_ast_call(lexer->allocator, init_string("factorial"), args);
+        ast_array_append(parser->allocator, &args, result);
+        result = init_ast_call(parser->allocator, BUILTIN_FACTORIAL, args);
     }
 
     return result;
 }
 
-AST *parse_factor(Lexer *lexer) {
-    AST *result = parse_exp(lexer);
+AST *parse_factor(Parser *parser) {
+    AST *result = parse_exp(parser);
 
-     while (lexer_peek_token(lexer).type == TOKEN_CARET) {
-        parser_eat(lexer, TOKEN_CARET);
+     while (parser_peek_type(parser) == TOKEN_CARET) {
+        parser_eat(parser, TOKEN_CARET);
         // when we use the same hierachy pattern like in parse_term or parse_expr, we need to call
         // parse_expr here. But unlike with addition and multiplication we want to parse pow operation
         // from right to left (this is more common, e.g. desmos, python, ...). 
         // For now I dont know if there are any edge cases, where this implementation is wrong.
-        result = init_ast_binop(lexer->allocator, result, parse_factor(lexer), OP_POW);
+        result = init_ast_binop(parser->allocator, result, parse_factor(parser), OP_POW);
     }
 
     return result;
 }
 
-AST *parse_term(Lexer *lexer) {
-    AST* result = parse_factor(lexer);
+AST *parse_term(Parser *parser) {
+    AST* result = parse_factor(parser);
 
     while (
-        lexer_peek_token(lexer).type == TOKEN_STAR ||
-        lexer_peek_token(lexer).type == TOKEN_SLASH ||
-        lexer_peek_token(lexer).type == TOKEN_PCT ||
-        lexer_peek_token(lexer).type == TOKEN_IDENTIFIER ||
-        lexer_peek_token(lexer).type == TOKEN_L_PAREN
+        parser_peek_type(parser) == TOKEN_STAR ||
+        parser_peek_type(parser) == TOKEN_SLASH ||
+        parser_peek_type(parser) == TOKEN_PCT ||
+        parser_peek_type(parser) == TOKEN_IDENTIFIER ||
+        parser_peek_type(parser) == TOKEN_L_PAREN
     ) {
-        switch (lexer_peek_token(lexer).type) {
+        switch (parser_peek_type(parser)) {
             case TOKEN_STAR:
-                parser_eat(lexer, TOKEN_STAR);
-                result = init_ast_binop(lexer->allocator, result, parse_factor(lexer), OP_MUL);
+                parser_eat(parser, TOKEN_STAR);
+                result = init_ast_binop(parser->allocator, result, parse_factor(parser), OP_MUL);
                 break;
             case TOKEN_SLASH:
-                parser_eat(lexer, TOKEN_SLASH);
-                result = init_ast_binop(lexer->allocator, result, parse_factor(lexer), OP_DIV);
+                parser_eat(parser, TOKEN_SLASH);
+                result = init_ast_binop(parser->allocator, result, parse_factor(parser), OP_DIV);
                 break;
             case TOKEN_PCT:
-                parser_eat(lexer, TOKEN_PCT);
-                result = init_ast_binop(lexer->allocator, result, parse_factor(lexer), OP_MOD);
+                parser_eat(parser, TOKEN_PCT);
+                result = init_ast_binop(parser->allocator, result, parse_factor(parser), OP_MOD);
                 break;
             case TOKEN_IDENTIFIER:
-                result = init_ast_binop(lexer->allocator, result, parse_factor(lexer), OP_MUL);
+                result = init_ast_binop(parser->allocator, result, parse_factor(parser), OP_MUL);
                 break;
             case TOKEN_L_PAREN:
-                result = init_ast_binop(lexer->allocator, result, parse_exp(lexer), OP_MUL);
+                result = init_ast_binop(parser->allocator, result, parse_exp(parser), OP_MUL);
                 break;
             default:
                 assert(false);
@@ -165,55 +211,67 @@ AST *parse_term(Lexer *lexer) {
     return result;
 }
 
-AST *parse_expr(Lexer* lexer) {
-    AST* result = parse_term(lexer);
+AST *parse_expr(Parser *parser) {
+    AST* result = parse_term(parser);
 
-    while (lexer_peek_token(lexer).type == TOKEN_PLUS || lexer_peek_token(lexer).type == TOKEN_MINUS) {
-        if (lexer_peek_token(lexer).type == TOKEN_PLUS) {
-            parser_eat(lexer, TOKEN_PLUS);
-            result = init_ast_binop(lexer->allocator, result, parse_term(lexer), OP_ADD);
-        } else if (lexer_peek_token(lexer).type == TOKEN_MINUS) {
-            parser_eat(lexer, TOKEN_MINUS);
-            result = init_ast_binop(lexer->allocator, result, parse_term(lexer), OP_SUB);
+    while (parser_peek_type(parser) == TOKEN_PLUS || parser_peek_type(parser) == TOKEN_MINUS) {
+        if (parser_peek_type(parser) == TOKEN_PLUS) {
+            parser_eat(parser, TOKEN_PLUS);
+            result = init_ast_binop(parser->allocator, result, parse_term(parser), OP_ADD);
+        } else if (parser_peek_type(parser) == TOKEN_MINUS) {
+            parser_eat(parser, TOKEN_MINUS);
+            result = init_ast_binop(parser->allocator, result, parse_term(parser), OP_SUB);
         }
     }
 
     return result;
 }
 
-AST *parse_assign(Lexer *lexer) {
-    AST *result = parse_expr(lexer);
+AST *parse_assign(Parser *parser) {
+    AST *result = parse_expr(parser);
 
-    if (lexer_peek_token(lexer).type == TOKEN_EQUAL) {
-        parser_eat(lexer, TOKEN_EQUAL);
-        AST *value = parse_expr(lexer);
+    if (parser_peek_type(parser) == TOKEN_EQUAL) {
+        parser_eat(parser, TOKEN_EQUAL);
+        AST *value = parse_expr(parser);
 
-        result = init_ast_assign(lexer->allocator, result, value);
+        // names of constants are still names on the left side, like they were before
+        // constants got resolved in the parser (reading them still gives the constant)
+        if (result->type == AST_CONSTANT) {
+            String name = intern(init_string(builtin_constant_to_string(result->constant.id)))->name;
+            result = init_ast_symbol(parser->allocator, name);
+        }
+
+        result = init_ast_assign(parser->allocator, result, value);
     }
 
-    switch (lexer_peek_token(lexer).type) {
-        case TOKEN_NEW_LINE: parser_eat(lexer, TOKEN_NEW_LINE); break;
-        case TOKEN_EOF: parser_eat(lexer, TOKEN_EOF); break;
+    switch (parser_peek_type(parser)) {
+        case TOKEN_NEW_LINE: parser_eat(parser, TOKEN_NEW_LINE); break;
+        case TOKEN_EOF: parser_eat(parser, TOKEN_EOF); break;
         default: todo(); // what should we expect different after assign then 'newline' or 'eof'?
     }
 
     return result;
 }
 
-AST *parse_program(Lexer *lexer) {
-    AST *prog = init_ast_program(lexer->allocator);
+AST *parse_program(Parser *parser) {
+    AST *prog = init_ast_program(parser->allocator);
 
-    while (lexer_peek_token(lexer).type != TOKEN_EOF) {
-        AST *result = parse_assign(lexer);
-        ast_array_append(lexer->allocator, &prog->program.statements, result);
+    while (parser_peek_type(parser) != TOKEN_EOF) {
+        AST *result = parse_assign(parser);
+        ast_array_append(parser->allocator, &prog->program.statements, result);
     }
 
     return prog;
 }
 
 AST *parse(Lexer *lexer) {
-    AST* result = parse_program(lexer);
-    // printf("%s\n", token_type_to_string(lexer_peek_token(lexer).type));
-    assert(lexer_peek_token(lexer).type == TOKEN_EOF);
+    Parser parser = {0};
+    parser.allocator = lexer->allocator;
+    parser_tokenize(&parser, lexer);
+
+    AST* result = parse_program(&parser);
+    assert(parser_peek_type(&parser) == TOKEN_EOF);
+
+    free(parser.tokens);
     return result;
 }
@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "casc.h"
+
+//
+// sieve
+//
+
+// odd primes up to n by the sieve of Eratosthenes, the caller frees the array
+u32 *sieve_odd_primes(u64 n, usize *count) {
+    assert(n < 0xffffffffu);
+    u8 *composite = calloc(n/2 + 1, 1); // composite[i] is about 2i+1
+    u32 *primes = malloc((n/2 + 1)*sizeof(u32));
+    assert(composite != NULL && primes != NULL);
+
+    *count = 0;
+    for (u64 i = 3; i <= n; i += 2) {
+        if (composite[i/2]) {
+            continue;
+        }
+        primes[(*count)++] = (u32)i;
+        for (u64 j = i*i; j <= n; j += 2*i) {
+            composite[j/2] = 1;
+        }
+    }
+
+    free(composite);
+    return primes;
+}
+
+// odd primes below SMALL_PRIMES_LIMIT, built once on first use
+static u32 *small_primes_table = NULL;
+static usize small_primes_count = 0;
+static pthread_once_t small_primes_once = PTHREAD_ONCE_INIT;
+
+void small_primes_build() {
+    small_primes_table = sieve_odd_primes(SMALL_PRIMES_LIMIT, &small_primes_count);
+}
+
+const u32 *small_primes(usize *count) {
+    pthread_once(&small_primes_once, small_primes_build);
+    *count = small_primes_count;
+    return small_primes_table;
+}
+
+//
+// 64 bit arithmetic
+//
+
+u64 u64_isqrt(u64 n) {
+    // the double has only 53 bits, so the guess can be off by a bit in either direction
+    u64 r = (u64)sqrt((f64)n);
+    if (r > 0xffffffffu) {
+        r = 0xffffffffu;
+    }
+    while (r*r > n) {
+        r -= 1;
+    }
+    while (r < 0xffffffffu && (r+1)*(r+1) <= n) {
+        r += 1;
+    }
+    return r;
+}
+
+// Montgomery form for an odd modulus n: x is kept as x*2^64 mod n, so a product needs
+// three multiplications instead of a 128 bit division
+typedef struct {
+    u64 n;
+    u64 inverse; // n^-1 mod 2^64
+    u64 one;     // 2^64 mod n
+    u64 r2;      // 2^128 mod n, to convert into the form
+} Montgomery;
+
+Montgomery init_montgomery(u64 n) {
+    assert(n & 1);
+    // every Newton step doubles the correct low bits, n*n = 1 mod 8 gives the first three
+    u64 inverse = n;
+    for (usize i = 0; i < 5; i++) {
+        inverse *= 2 - n*inverse;
+    }
+    u64 one = -n % n;
+    u64 r2 = (u64)((unsigned __int128)one*one % n);
+    return (Montgomery){ n, inverse, one, r2 };
+}
+
+// a*b/2^64 mod n. The low word of a*b - q*n is zero, so only the high words remain.
+u64 montgomery_mul(const Montgomery *m, u64 a, u64 b) {
+    unsigned __int128 product = (unsigned __int128)a*b;
+    u64 q = (u64)product*m->inverse;
+    u64 high = (u64)(product >> 64);
+    u64 qn_high = (u64)(((unsigned __int128)q*m->n) >> 64);
+    return high >= qn_high ? high - qn_high : high - qn_high + m->n;
+}
+
+u64 to_montgomery(const Montgomery *m, u64 x) {
+    return montgomery_mul(m, x % m->n, m->r2);
+}
+
+u64 montgomery_pow(const Montgomery *m, u64 base, u64 exponent) {
+    u64 result = m->one;
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result = montgomery_mul(m, result, base);
+        }
+        base = montgomery_mul(m, base, base);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+// Miller-Rabin with bases for which no composite below the bound is a strong pseudoprime
+bool u64_is_prime(u64 n) {
+    if (n < 2) {
+        return false;
+    }
+    static const u32 FIRST_PRIMES[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+    for (usize i = 0; i < sizeof(FIRST_PRIMES)/sizeof(FIRST_PRIMES[0]); i++) {
+        if (n % FIRST_PRIMES[i] == 0) {
+            return n == FIRST_PRIMES[i];
+        }
+    }
+    if (n < 37*37) {
+        return true;
+    }
+
+    // n-1 = d*2^s with an odd d
+    u64 d = n - 1;
+    u32 s = __builtin_ctzll(d);
+    d >>= s;
+
+    static const u64 BASES_32[] = { 2, 7, 61 }; // below 4759123141
+    static const u64 BASES_64[] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+    const u64 *bases = n < 4759123141ull ? BASES_32 : BASES_64;
+    usize base_count = n < 4759123141ull ? 3 : 7;
+
+    Montgomery m = init_montgomery(n);
+    u64 minus_one = n - m.one;
+    for (usize i = 0; i < base_count; i++) {
+        if (bases[i] % n == 0) {
+            continue;
+        }
+        u64 x = montgomery_pow(&m, to_montgomery(&m, bases[i]), d);
+        if (x == m.one || x == minus_one) {
+            continue;
+        }
+        bool witness = true;
+        for (u32 r = 1; r < s && witness; r++) {
+            x = montgomery_mul(&m, x, x);
+            witness = x != minus_one;
+        }
+        if (witness) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool u64_next_prime(u64 n, u64 *prime) {
+    if (n < 2) {
+        *prime = 2;
+        return true;
+    }
+    if (n >= U64_MAX_PRIME) {
+        return false;
+    }
+    u64 candidate = (n + 1) | 1;
+    while (!u64_is_prime(candidate)) {
+        candidate += 2;
+    }
+    *prime = candidate;
+    return true;
+}
+
+//
+// factorization
+//
+
+// x^2 + c mod n in Montgomery form, the factors found are the same
+u64 pollard_step(const Montgomery *m, u64 x, u64 c) {
+    u64 square = montgomery_mul(m, x, x);
+    return square >= m->n - c ? square - (m->n - c) : square + c;
+}
+
+// Brent's variant of Pollard's rho, n has to be odd and composite. The differences are
+// multiplied together, so there is only one gcd per batch. If the batch overshot, it is
+// walked again one step at a time, and if that fails too we try another polynomial.
+u64 pollard_brent(u64 n) {
+    Montgomery m = init_montgomery(n);
+    for (u64 c = 1;; c++) {
+        u64 x = 2, y = 2, saved = 2, q = m.one, g = 1;
+        for (u64 r = 1; g == 1; r *= 2) {
+            x = y;
+            for (u64 i = 0; i < r; i++) {
+                y = pollard_step(&m, y, c);
+            }
+            for (u64 k = 0; k < r && g == 1; k += POLLARD_BATCH) {
+                saved = y;
+                for (u64 i = 0; i < POLLARD_BATCH && i < r - k; i++) {
+                    y = pollard_step(&m, y, c);
+                    q = montgomery_mul(&m, q, x > y ? x - y : y - x);
+                }
+                g = u64_gcd(q, n);
+            }
+        }
+
+        if (g == n) {
+            do {
+                saved = pollard_step(&m, saved, c);
+                g = u64_gcd(x > saved ? x - saved : saved - x, n);
+            } while (g == 1);
+        }
+        if (g != n) {
+            return g;
+        }
+    }
+}
+
+void factorization_add(Factorization *factorization, u64 prime, u32 exponent) {
+    usize i = 0;
+    while (i < factorization->count && factorization->primes[i] < prime) {
+        i += 1;
+    }
+    if (i < factorization->count && factorization->primes[i] == prime) {
+        factorization->exponents[i] += exponent;
+        return;
+    }
+
+    assert(factorization->count < FACTORIZATION_MAX_PRIMES);
+    usize tail = factorization->count - i;
+    memmove(&factorization->primes[i+1], &factorization->primes[i], tail*sizeof(u64));
+    memmove(&factorization->exponents[i+1], &factorization->exponents[i], tail*sizeof(u8));
+    factorization->primes[i] = prime;
+    factorization->exponents[i] = exponent;
+    factorization->count += 1;
+}
+
+// n has no prime factors below TRIAL_DIVISION_LIMIT, every factor found counts exponent times
+void factor_rec(Factorization *factorization, u64 n, u32 exponent) {
+    if (n == 1) {
+        return;
+    }
+    // without a factor below the limit everything below its square is prime
+    if (n < (u64)TRIAL_DIVISION_LIMIT*TRIAL_DIVISION_LIMIT || u64_is_prime(n)) {
+        factorization_add(factorization, n, exponent);
+        return;
+    }
+
+    // rho needs a long time to split p^2, but those are cheap to spot
+    u64 root = u64_isqrt(n);
+    if (root*root == n) {
+        factor_rec(factorization, root, 2*exponent);
+        return;
+    }
+
+    u64 d = pollard_brent(n);
+    factor_rec(factorization, d, exponent);
+    factor_rec(factorization, n/d, exponent);
+}
+
+// Odd primes below TRIAL_DIVISION_LIMIT with their inverse mod 2^64. For a multiple of p
+// the product with the inverse is the exact quotient, for anything else it is bigger
+// than UINT64_MAX/p, so a trial division is one multiplication.
+typedef struct {
+    u64 inverse;
+    u64 max_quotient;
+    u32 prime;
+} TrialDivisor;
+
+static TrialDivisor trial_divisors[TRIAL_DIVISION_LIMIT/2];
+static usize trial_divisors_count = 0;
+static pthread_once_t trial_divisors_once = PTHREAD_ONCE_INIT;
+
+void trial_divisors_build() {
+    usize count;
+    const u32 *primes = small_primes(&count);
+    for (usize i = 0; i < count && primes[i] < TRIAL_DIVISION_LIMIT; i++) {
+        u64 p = primes[i];
+        u64 inverse = p;
+        for (usize j = 0; j < 5; j++) {
+            inverse *= 2 - p*inverse;
+        }
+        trial_divisors[trial_divisors_count++] = (TrialDivisor){ inverse, UINT64_MAX/p, (u32)p };
+    }
+}
+
+// rho results by n, direct mapped, one cache per thread like the arena pool
+typedef struct {
+    u64 n;
+    Factorization factorization;
+} FactorCacheEntry;
+
+static _Thread_local FactorCacheEntry factor_cache[FACTOR_CACHE_SIZE];
+
+Factorization u64_factor(u64 n) {
+    assert(n > 0);
+    Factorization factorization = {0};
+
+    FactorCacheEntry *cached = &factor_cache[((n*0x9e3779b97f4a7c15ull) >> 32) & (FACTOR_CACHE_SIZE-1)];
+    if (cached->n == n) {
+        return cached->factorization;
+    }
+    u64 original = n;
+
+    if (n % 2 == 0) {
+        u32 twos = __builtin_ctzll(n);
+        factorization_add(&factorization, 2, twos);
+        n >>= twos;
+    }
+
+    pthread_once(&trial_divisors_once, trial_divisors_build);
+    for (usize i = 0; i < trial_divisors_count; i++) {
+        TrialDivisor divisor = trial_divisors[i];
+        if ((u64)divisor.prime*divisor.prime > n) {
+            break;
+        }
+        if (n*divisor.inverse <= divisor.max_quotient) {
+            u32 exponent = 0;
+            do {
+                n *= divisor.inverse;
+                exponent += 1;
+            } while (n*divisor.inverse <= divisor.max_quotient);
+            factorization_add(&factorization, divisor.prime, exponent);
+        }
+    }
+
+    // without a factor below the limit everything below its square is prime
+    if (n < (u64)TRIAL_DIVISION_LIMIT*TRIAL_DIVISION_LIMIT || u64_is_prime(n)) {
+        if (n > 1) {
+            factorization_add(&factorization, n, 1);
+        }
+        return factorization;
+    }
+
+    factor_rec(&factorization, n, 1);
+    cached->n = original;
+    cached->factorization = factorization;
+    return factorization;
+}
+
+//
+// square-free decomposition
+//
+
+void u64_square_free(u64 n, u64 *outside, u64 *inside) {
+    Factorization factorization = u64_factor(n);
+    *outside = 1;
+    *inside = 1;
+    for (usize i = 0; i < factorization.count; i++) {
+        u64 p = factorization.primes[i];
+        for (u32 j = 0; j < factorization.exponents[i]/2; j++) {
+            *outside *= p;
+        }
+        if (factorization.exponents[i] & 1) {
+            *inside *= p;
+        }
+    }
+}
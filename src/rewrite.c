@@ -0,0 +1,510 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "casc.h"
+
+// Rules which only depend on the shape of a node. Adding a rule is adding a line here,
+// the index and the worklist pick it up. Replacements should be smaller (or simpler)
+// than their pattern, otherwise rewriting may not terminate before REWRITE_MAX_STEPS.
+static RewriteRule RULES[] = {
+    // powers
+    { "x^0", MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_INTEGER(0)), MATCH_INTEGER(1) },
+    { "x^1", MATCH_BINOP(OP_POW, MATCH_ANY(1), MATCH_INTEGER(1)), MATCH_ANY(1) },
+    { "1^x", MATCH_BINOP(OP_POW, MATCH_INTEGER(1), MATCH_ANY(1)), MATCH_INTEGER(1) },
+    { "x/1", MATCH_BINOP(OP_DIV, MATCH_ANY(1), MATCH_INTEGER(1)), MATCH_ANY(1) },
+
+    // signs
+    { "+x", MATCH_UNARYOP(OP_UADD, MATCH_ANY(1)), MATCH_ANY(1) },
+    { "-(-x)", MATCH_UNARYOP(OP_USUB, MATCH_UNARYOP(OP_USUB, MATCH_ANY(1))), MATCH_ANY(1) },
+    { "abs(-x)", MATCH_CALL(BUILTIN_ABS, MATCH_UNARYOP(OP_USUB, MATCH_ANY(1))), MATCH_CALL(BUILTIN_ABS, MATCH_ANY(1)) },
+
+    // trigonometry
+    { "sin(0)", MATCH_CALL(BUILTIN_SIN, MATCH_INTEGER(0)), MATCH_INTEGER(0) },
+    { "sin(pi)", MATCH_CALL(BUILTIN_SIN, MATCH_CONSTANT(CONSTANT_PI)), MATCH_INTEGER(0) },
+    { "cos(0)", MATCH_CALL(BUILTIN_COS, MATCH_INTEGER(0)), MATCH_INTEGER(1) },
+    { "cos(pi/2)", MATCH_CALL(BUILTIN_COS, MATCH_BINOP(OP_DIV, MATCH_CONSTANT(CONSTANT_PI), MATCH_INTEGER(2))), MATCH_INTEGER(0) },
+    { "cos(pi)", MATCH_CALL(BUILTIN_COS, MATCH_CONSTANT(CONSTANT_PI)), MATCH_INTEGER(-1) },
+
+    // roots and logarithms
+    { "sqrt(0)", MATCH_CALL(BUILTIN_SQRT, MATCH_INTEGER(0)), MATCH_INTEGER(0) },
+    { "sqrt(1)", MATCH_CALL(BUILTIN_SQRT, MATCH_INTEGER(1)), MATCH_INTEGER(1) },
+    { "ln(1)", MATCH_CALL(BUILTIN_LN, MATCH_INTEGER(1)), MATCH_INTEGER(0) },
+    { "ln(e)", MATCH_CALL(BUILTIN_LN, MATCH_CONSTANT(CONSTANT_E)), MATCH_INTEGER(1) },
+    { "log(1, b)", MATCH_CALL(BUILTIN_LOG, MATCH_INTEGER(1), MATCH_ANY(1)), MATCH_INTEGER(0) },
+    { "log(b, b)", MATCH_CALL(BUILTIN_LOG, MATCH_ANY(1), MATCH_ANY(1)), MATCH_INTEGER(1) },
+
+    // combinatorics
+    { "0!", MATCH_CALL(BUILTIN_FACTORIAL, MATCH_INTEGER(0)), MATCH_INTEGER(1) },
+};
+
+#define RULES_COUNT (sizeof(RULES)/sizeof(RULES[0]))
+
+// Rules are grouped by head: ops (binary and unary) first, then builtin functions.
+// Nodes with any other head have no rules.
+#define REWRITE_HEAD_COUNT (OP_TYPE_COUNT + BUILTIN_FUNCTION_COUNT)
+
+usize rewrite_head(AST *node) {
+    switch (node->type) {
+        case AST_BINOP: return node->binop.op;
+        case AST_UNARYOP: return node->unaryop.op;
+        case AST_CALL: return OP_TYPE_COUNT + node->func_call.function;
+        default: return REWRITE_HEAD_COUNT;
+    }
+}
+
+usize rewrite_pattern_head(Pattern *pattern) {
+    switch (pattern->type) {
+        case PATTERN_BINOP: return pattern->binop.op;
+        case PATTERN_UNARYOP: return pattern->unaryop.op;
+        case PATTERN_CALL: return OP_TYPE_COUNT + pattern->call.function;
+        default: panic("rule patterns need an op or function at the root");
+    }
+}
+
+//
+// discrimination tree
+//
+
+// Every pattern is flattened in preorder into a path of keys, all rules of a head share
+// one tree. Looking up a node walks the tree along the node's own preorder, a wildcard
+// edge skips a whole subtree. So a node is only checked against the rules whose shape
+// it has, and the walk is bounded by the size of the patterns, not the number of rules.
+// pattern_match only runs for the rules at the end of the walk, it still has to check
+// that a slot used twice binds equal nodes.
+
+#define DISC_ANY AST_TYPE_COUNT // any subtree
+#define DISC_ANY_INTEGER (AST_TYPE_COUNT+1) // any integer leaf
+
+// limit for the subtrees waiting to be visited during a lookup
+#define DISC_MAX_PENDING 16
+
+typedef struct {
+    u8 type; // ASTType, DISC_ANY or DISC_ANY_INTEGER
+    u8 tag; // OpType, BuiltinFunction or BuiltinConstant
+    u8 arity;
+    i64 value; // integers only
+} DiscKey;
+
+typedef struct DiscNode DiscNode;
+
+typedef struct {
+    DiscKey key;
+    DiscNode *child;
+} DiscEdge;
+
+struct DiscNode {
+    DiscEdge *edges;
+    usize edges_count;
+
+    // rules whose path ends here, indices into RULES
+    usize *rules;
+    usize rules_count;
+};
+
+// one tree per head, the root has the edge of the head node itself, built once on first use
+static DiscNode disc_roots[REWRITE_HEAD_COUNT];
+static pthread_once_t disc_once = PTHREAD_ONCE_INIT;
+
+bool disc_key_eq(DiscKey a, DiscKey b) {
+    return a.type == b.type && a.tag == b.tag && a.arity == b.arity && a.value == b.value;
+}
+
+DiscKey disc_key_of_node(AST *node) {
+    switch (node->type) {
+        case AST_INTEGER: return (DiscKey){ .type = AST_INTEGER, .value = node->integer.value };
+        case AST_CONSTANT: return (DiscKey){ .type = AST_CONSTANT, .tag = node->constant.id };
+        case AST_BINOP: return (DiscKey){ .type = AST_BINOP, .tag = node->binop.op, .arity = 2 };
+        case AST_UNARYOP: return (DiscKey){ .type = AST_UNARYOP, .tag = node->unaryop.op, .arity = 1 };
+        case AST_CALL: {
+            // calls with more args than any pattern can't match anyway
+            usize arity = node->func_call.args.size;
+            return (DiscKey){ .type = AST_CALL, .tag = node->func_call.function, .arity = arity < 0xff ? arity : 0xff };
+        }
+        // no pattern matches these exactly
+        default: return (DiscKey){ .type = node->type };
+    }
+}
+
+DiscKey disc_key_of_pattern(Pattern *pattern) {
+    switch (pattern->type) {
+        case PATTERN_ANY: return (DiscKey){ .type = DISC_ANY };
+        case PATTERN_ANY_INTEGER: return (DiscKey){ .type = DISC_ANY_INTEGER };
+        case PATTERN_INTEGER: return (DiscKey){ .type = AST_INTEGER, .value = pattern->value };
+        case PATTERN_CONSTANT: return (DiscKey){ .type = AST_CONSTANT, .tag = pattern->constant };
+        case PATTERN_BINOP: return (DiscKey){ .type = AST_BINOP, .tag = pattern->binop.op, .arity = 2 };
+        case PATTERN_UNARYOP: return (DiscKey){ .type = AST_UNARYOP, .tag = pattern->unaryop.op, .arity = 1 };
+        case PATTERN_CALL: {
+            u8 arity = 0;
+            while (arity < PATTERN_MAX_ARGS && pattern->call.args[arity] != NULL) {
+                arity += 1;
+            }
+            return (DiscKey){ .type = AST_CALL, .tag = pattern->call.function, .arity = arity };
+        }
+    }
+    panic("unreachable");
+}
+
+Pattern *pattern_child(Pattern *pattern, usize i) {
+    switch (pattern->type) {
+        case PATTERN_BINOP: return i == 0 ? pattern->binop.left : pattern->binop.right;
+        case PATTERN_UNARYOP: return pattern->unaryop.operand;
+        case PATTERN_CALL: return pattern->call.args[i];
+        default: panic("pattern has no children");
+    }
+}
+
+DiscNode *disc_child(DiscNode *node, DiscKey key) {
+    for (usize i = 0; i < node->edges_count; i++) {
+        if (disc_key_eq(node->edges[i].key, key)) {
+            return node->edges[i].child;
+        }
+    }
+
+    DiscNode *child = calloc(1, sizeof(DiscNode));
+    node->edges = realloc(node->edges, (node->edges_count+1)*sizeof(DiscEdge));
+    assert(child != NULL && node->edges != NULL);
+    node->edges[node->edges_count++] = (DiscEdge){ key, child };
+    return child;
+}
+
+void disc_insert(usize rule) {
+    Pattern *root = RULES[rule].pattern;
+    DiscNode *node = &disc_roots[rewrite_pattern_head(root)];
+
+    // preorder with an explicit stack, the top is visited next
+    Pattern *pending[DISC_MAX_PENDING] = { root };
+    usize count = 1;
+    while (count > 0) {
+        Pattern *pattern = pending[--count];
+        DiscKey key = disc_key_of_pattern(pattern);
+        node = disc_child(node, key);
+
+        assert(count + key.arity <= DISC_MAX_PENDING); // pattern too big
+        for (usize i = key.arity; i > 0; i--) {
+            pending[count++] = pattern_child(pattern, i-1);
+        }
+    }
+
+    node->rules = realloc(node->rules, (node->rules_count+1)*sizeof(usize));
+    assert(node->rules != NULL);
+    node->rules[node->rules_count++] = rule;
+}
+
+void disc_build() {
+    for (usize i = 0; i < RULES_COUNT; i++) {
+        disc_insert(i);
+    }
+}
+
+AST *pending_child(AST *node, usize i) {
+    switch (node->type) {
+        case AST_BINOP: return i == 0 ? node->binop.left : node->binop.right;
+        case AST_UNARYOP: return node->unaryop.operand;
+        case AST_CALL: return node->func_call.args.data[i];
+        default: panic("node has no children");
+    }
+}
+
+// Finds the first rule (in the order of RULES) that matches root, best is the index of
+// the best rule so far. pending are the subtrees of root still to visit, top last.
+void disc_lookup(DiscNode *disc, AST **pending, usize count, AST *root, AST **bindings, usize *best) {
+    if (count == 0) {
+        for (usize i = 0; i < disc->rules_count; i++) {
+            usize rule = disc->rules[i];
+            if (rule >= *best) {
+                continue;
+            }
+
+            AST *candidate[PATTERN_MAX_SLOTS] = {0};
+            if (pattern_match(RULES[rule].pattern, root, candidate)) {
+                memcpy(bindings, candidate, sizeof(candidate));
+                *best = rule;
+            }
+        }
+        return;
+    }
+
+    AST *node = pending[count-1];
+    DiscKey key = disc_key_of_node(node);
+    for (usize i = 0; i < disc->edges_count; i++) {
+        DiscEdge edge = disc->edges[i];
+        if (edge.key.type == DISC_ANY || (edge.key.type == DISC_ANY_INTEGER && ast_is_integer(node))) {
+            disc_lookup(edge.child, pending, count-1, root, bindings, best);
+        } else if (disc_key_eq(edge.key, key)) {
+            // replace the node by its children, the first child on top
+            AST *next[DISC_MAX_PENDING];
+            memcpy(next, pending, (count-1)*sizeof(AST*));
+            usize next_count = count-1;
+            for (usize j = key.arity; j > 0; j--) {
+                next[next_count++] = pending_child(node, j-1);
+            }
+            disc_lookup(edge.child, next, next_count, root, bindings, best);
+        }
+    }
+}
+
+// applies the first matching rule at the root of node, NULL if there is none
+AST *rewrite_step(Interp *ip, AST *node, AST **bindings) {
+    pthread_once(&disc_once, disc_build);
+
+    usize head = rewrite_head(node);
+    if (head == REWRITE_HEAD_COUNT) {
+        return NULL;
+    }
+
+    usize best = RULES_COUNT;
+    AST *pending[1] = { node };
+    disc_lookup(&disc_roots[head], pending, 1, node, bindings, &best);
+    if (best == RULES_COUNT) {
+        return NULL;
+    }
+
+    return pattern_build(ip->allocator, RULES[best].replacement, bindings);
+}
+
+//
+// worklist
+//
+
+typedef struct {
+    AST *key;
+    AST *value;
+} RewriteEntry;
+
+typedef struct {
+    AST *node; // current form, replaced every time a rule fires
+    AST *origin; // the node this item was pushed for
+} RewriteItem;
+
+typedef struct {
+    Interp *ip;
+
+    // Rewritten form of every finished subtree. Keys are compared structurally, so
+    // equal subtrees are only rewritten once. Open addressing, capacity is a power of 2.
+    RewriteEntry *done;
+    usize done_capacity;
+    usize done_count;
+
+    RewriteItem *stack;
+    usize stack_size;
+    usize stack_capacity;
+
+    usize steps;
+} Rewriter;
+
+bool rewrite_is_leaf(AST *node) {
+    switch (node->type) {
+        case AST_BINOP:
+        case AST_UNARYOP:
+        case AST_CALL:
+        case AST_LIST:
+            return false;
+        default:
+            // assigns and programs aren't expressions, they are left alone
+            return true;
+    }
+}
+
+AST *rewriter_get(Rewriter *rw, AST *node) {
+    if (rewrite_is_leaf(node)) {
+        return node;
+    }
+    if (rw->done_capacity == 0) {
+        return NULL;
+    }
+
+    usize mask = rw->done_capacity-1;
+    for (usize i = node->hash & mask; rw->done[i].key != NULL; i = (i+1) & mask) {
+        if (ast_match(rw->done[i].key, node)) {
+            return rw->done[i].value;
+        }
+    }
+    return NULL;
+}
+
+void rewriter_put(Rewriter *rw, AST *key, AST *value) {
+    if (rewrite_is_leaf(key)) {
+        return;
+    }
+
+    if (4*(rw->done_count+1) > 3*rw->done_capacity) {
+        RewriteEntry *old = rw->done;
+        usize old_capacity = rw->done_capacity;
+
+        rw->done_capacity = old_capacity == 0 ? 64 : old_capacity*2;
+        rw->done = calloc(rw->done_capacity, sizeof(RewriteEntry));
+        assert(rw->done != NULL);
+        rw->done_count = 0;
+        for (usize i = 0; i < old_capacity; i++) {
+            if (old[i].key != NULL) {
+                rewriter_put(rw, old[i].key, old[i].value);
+            }
+        }
+        free(old);
+    }
+
+    usize mask = rw->done_capacity-1;
+    usize i = key->hash & mask;
+    for (; rw->done[i].key != NULL; i = (i+1) & mask) {
+        if (ast_match(rw->done[i].key, key)) {
+            return;
+        }
+    }
+    rw->done[i] = (RewriteEntry){ key, value };
+    rw->done_count += 1;
+}
+
+void rewriter_push(Rewriter *rw, AST *node) {
+    if (rw->stack_size == rw->stack_capacity) {
+        rw->stack_capacity = rw->stack_capacity == 0 ? 64 : rw->stack_capacity*2;
+        rw->stack = realloc(rw->stack, rw->stack_capacity*sizeof(RewriteItem));
+        assert(rw->stack != NULL);
+    }
+    rw->stack[rw->stack_size++] = (RewriteItem){ node, node };
+}
+
+// pushes all children which aren't rewritten yet, returns how many
+usize rewriter_push_children(Rewriter *rw, AST *node) {
+    usize before = rw->stack_size;
+    switch (node->type) {
+        case AST_BINOP:
+            if (rewriter_get(rw, node->binop.right) == NULL) rewriter_push(rw, node->binop.right);
+            if (rewriter_get(rw, node->binop.left) == NULL) rewriter_push(rw, node->binop.left);
+            break;
+        case AST_UNARYOP:
+            if (rewriter_get(rw, node->unaryop.operand) == NULL) rewriter_push(rw, node->unaryop.operand);
+            break;
+        case AST_CALL:
+        case AST_LIST: {
+            ASTArray nodes = node->type == AST_CALL ? node->func_call.args : node->list.nodes;
+            for (usize i = nodes.size; i > 0; i--) {
+                if (rewriter_get(rw, nodes.data[i-1]) == NULL) rewriter_push(rw, nodes.data[i-1]);
+            }
+            break;
+        }
+        default: break;
+    }
+    return rw->stack_size - before;
+}
+
+// node with its children replaced by their rewritten form, node itself if none changed
+AST *rewriter_rebuild(Rewriter *rw, AST *node) {
+    Allocator *allocator = rw->ip->allocator;
+    switch (node->type) {
+        case AST_BINOP: {
+            AST *left = rewriter_get(rw, node->binop.left);
+            AST *right = rewriter_get(rw, node->binop.right);
+            if (left == node->binop.left && right == node->binop.right) {
+                return node;
+            }
+            return init_ast_binop(allocator, left, right, node->binop.op);
+        }
+        case AST_UNARYOP: {
+            AST *operand = rewriter_get(rw, node->unaryop.operand);
+            if (operand == node->unaryop.operand) {
+                return node;
+            }
+            return init_ast_unaryop(allocator, operand, node->unaryop.op);
+        }
+        case AST_CALL:
+        case AST_LIST: {
+            ASTArray nodes = node->type == AST_CALL ? node->func_call.args : node->list.nodes;
+            bool changed = false;
+            for (usize i = 0; i < nodes.size && !changed; i++) {
+                changed = rewriter_get(rw, nodes.data[i]) != nodes.data[i];
+            }
+            if (!changed) {
+                return node;
+            }
+
+            if (node->type == AST_LIST) {
+                AST *list = init_ast_list(allocator, nodes.size);
+                for (usize i = 0; i < nodes.size; i++) {
+                    list_append(allocator, list, rewriter_get(rw, nodes.data[i]));
+                }
+                return list;
+            }
+            ASTArray args = init_ast_array_with_capacity(allocator, nodes.size);
+            for (usize i = 0; i < nodes.size; i++) {
+                ast_array_append(allocator, &args, rewriter_get(rw, nodes.data[i]));
+            }
+            return init_ast_call(allocator, node->func_call.function, args);
+        }
+        default: return node;
+    }
+}
+
+// Bottom-up worklist: an item is only rewritten after all its children are done. When
+// a rule fires the item continues with the replacement, whose new children get pushed
+// in turn while the reused ones are already done. So every distinct subtree is visited
+// once plus once for every node a rule creates, no matter how deep the tree is.
+AST *rewriter_run(Rewriter *rw, AST *root) {
+    AST *bindings[PATTERN_MAX_SLOTS];
+
+    rewriter_push(rw, root);
+    while (rw->stack_size > 0) {
+        usize top = rw->stack_size-1;
+        AST *node = rw->stack[top].node;
+
+        AST *result = rewriter_get(rw, node);
+        if (result == NULL) {
+            if (rewriter_push_children(rw, node) > 0) {
+                continue;
+            }
+
+            AST *rebuilt = rewriter_rebuild(rw, node);
+            AST *replacement = rw->steps < REWRITE_MAX_STEPS ? rewrite_step(rw->ip, rebuilt, bindings) : NULL;
+            if (replacement != NULL) {
+                rw->steps += 1;
+                rw->stack[top].node = replacement;
+                continue;
+            }
+
+            result = rebuilt;
+            rewriter_put(rw, node, result);
+            rewriter_put(rw, rebuilt, result);
+        }
+
+        rewriter_put(rw, rw->stack[top].origin, result);
+        rw->stack_size -= 1;
+    }
+
+    return rewriter_get(rw, root);
+}
+
+void free_rewriter(Rewriter *rw) {
+    free(rw->done);
+    free(rw->stack);
+}
+
+AST *rewrite_node(Interp *ip, AST *node) {
+    AST *bindings[PATTERN_MAX_SLOTS];
+    AST *replacement = rewrite_step(ip, node, bindings);
+    if (replacement == NULL) {
+        return NULL;
+    }
+
+    // most rules return a leaf or one of the (already rewritten) children
+    bool is_binding = false;
+    for (usize i = 1; i < PATTERN_MAX_SLOTS; i++) {
+        is_binding = is_binding || bindings[i] == replacement;
+    }
+    if (is_binding || rewrite_is_leaf(replacement)) {
+        return replacement;
+    }
+
+    // only the nodes built by the rule are left to rewrite
+    Rewriter rw = { .ip = ip, .steps = 1 };
+    for (usize i = 1; i < PATTERN_MAX_SLOTS; i++) {
+        if (bindings[i] != NULL) {
+            rewriter_put(&rw, bindings[i], bindings[i]);
+        }
+    }
+    AST *result = rewriter_run(&rw, replacement);
+    free_rewriter(&rw);
+    return result;
+}